@@ -64,28 +64,17 @@ template<int pin>
 using HoldPinHigh = DigitalPinHolder<pin, HIGH, LOW>;
 
 /**
- * Base case for shiftOutMultiple, is a wrapper around shiftOut.
+ * Call shiftOut for each provided argument; If you have a lot of data to clock
+ * out, this function is for you.
  * @param dataPin the pin to send data out on
  * @param clockPin the pin that clocks the data to be sent out
  * @param order start with the most or least significant bit first
- * @param value The value to be written out
- * @tparam T the type of the value to be written out
- */
-template<typename T>
-inline void shiftOutMultiple(int dataPin, int clockPin, decltype(MSBFIRST) order, T value) noexcept {
-    shiftOut(dataPin, clockPin, order, value);
-}
-/**
- * Call shiftOut for each provided argument; If you have a lot of data to clock
- * out, this function is for you. This version requires a minimum of two
- * arguments.
+ * @param values The values to be written out, in order
  */
-template<typename T, typename ... Args>
-void shiftOutMultiple(int dataPin, int clockPin, decltype(MSBFIRST) order, T value, Args&& ... rest) noexcept {
-    shiftOut(dataPin, clockPin, order, value);
-    if (sizeof...(rest) > 0) {
-        shiftOutMultiple(dataPin, clockPin, order, rest...);
-    }
+template<typename ... Args>
+inline void shiftOutMultiple(int dataPin, int clockPin, decltype(MSBFIRST) order, Args&& ... values) noexcept {
+    static_assert(sizeof...(values) > 0, "Nothing to shift out!");
+    (shiftOut(dataPin, clockPin, order, values), ...);
 }
 
 /**
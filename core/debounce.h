@@ -0,0 +1,88 @@
+/**
+ * @file
+ * Bit parallel debouncing of a whole port worth of inputs at once
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_CORE_DEBOUNCE_H__
+#define LIB_CORE_DEBOUNCE_H__
+#include "Arduino.h"
+namespace bonuspin
+{
+/**
+ * Debounces every bit of T in parallel with a two bit vertical counter per
+ * bit: bit n of the two counter words together count how many samples in a
+ * row pin n has disagreed with its debounced state. A pin changes state
+ * after four consecutive disagreeing samples and any agreeing sample resets
+ * its counter, so the cost of a sample is a few logic operations no matter
+ * how wide T is. Use uint16_t for one MCP23x17, a uint32_t to combine two or
+ * one debouncer per device for more.
+ * @tparam T the unsigned word type holding one bit per pin
+ * @tparam activeLow pins read LOW while pressed (buttons with pullups)
+ */
+template<typename T = uint16_t, bool activeLow = true>
+class VerticalCounterDebouncer final {
+    public:
+        using Word = T;
+        static constexpr bool ActiveLow = activeLow;
+        /// the idle reading of every pin
+        static constexpr Word Released = activeLow ? static_cast<Word>(~static_cast<Word>(0)) : static_cast<Word>(0);
+    public:
+        explicit VerticalCounterDebouncer(Word initial = Released) noexcept : _state(initial) { }
+        /**
+         * Feed the next raw reading of the pins.
+         * @return the pins whose debounced state changed with this sample
+         */
+        Word update(Word sample) noexcept {
+            Word delta = sample ^ _state;
+            _count1 = (_count1 ^ _count0) & delta;
+            _count0 = static_cast<Word>(~_count0) & delta;
+            _toggled = delta & static_cast<Word>(~(_count0 | _count1));
+            _state ^= _toggled;
+            return _toggled;
+        }
+        /**
+         * Read the port of a device (anything with readGPIOs) and feed it.
+         */
+        template<typename Device>
+        Word sample(Device& device) noexcept {
+            return update(static_cast<Word>(device.readGPIOs()));
+        }
+        /// the debounced pin levels
+        Word getState() const noexcept { return _state; }
+        /// pins which went high on the last sample
+        Word rose() const noexcept { return _toggled & _state; }
+        /// pins which went low on the last sample
+        Word fell() const noexcept { return _toggled & static_cast<Word>(~_state); }
+        /// pins which became pressed on the last sample
+        Word pressed() const noexcept { return ActiveLow ? fell() : rose(); }
+        /// pins which became released on the last sample
+        Word released() const noexcept { return ActiveLow ? rose() : fell(); }
+        /// pins which are currently held down
+        Word held() const noexcept { return ActiveLow ? static_cast<Word>(~_state) : _state; }
+        bool isPressed(byte pin) const noexcept { return (held() >> pin) & 1; }
+    private:
+        Word _state;
+        Word _count0 = 0;
+        Word _count1 = 0;
+        Word _toggled = 0;
+};
+
+} // end namespace bonuspin
+#endif // end LIB_CORE_DEBOUNCE_H__
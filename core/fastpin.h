@@ -0,0 +1,175 @@
+/**
+ * @file
+ * Compile time resolution of Arduino pin numbers to port registers so that
+ * pins known at compile time can be changed with a single instruction
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_CORE_FASTPIN_H__
+#define LIB_CORE_FASTPIN_H__
+#include "Arduino.h"
+// Only the ATmega328P family (Uno, Nano, Pro Mini) pin mapping is known,
+// every other core falls back to digitalWrite/digitalRead
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || \
+    defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || \
+    defined(__AVR_ATmega8__)
+#define BONUSPIN_HAS_FAST_PINS
+#endif
+namespace bonuspin
+{
+enum class FastPort : byte {
+    None,
+    B,
+    C,
+    D,
+};
+
+constexpr FastPort fastPortOf([[maybe_unused]] int pin) noexcept {
+#ifdef BONUSPIN_HAS_FAST_PINS
+    if (pin >= 0 && pin < 8) {
+        return FastPort::D;
+    } else if (pin >= 8 && pin < 14) {
+        return FastPort::B;
+    } else if (pin >= 14 && pin < 20) {
+        return FastPort::C;
+    }
+#endif
+    return FastPort::None;
+}
+
+constexpr byte fastBitOf(int pin) noexcept {
+    switch (fastPortOf(pin)) {
+        case FastPort::D:
+            return pin;
+        case FastPort::B:
+            return pin - 8;
+        case FastPort::C:
+            return pin - 14;
+        default:
+            return 0;
+    }
+}
+
+template<FastPort port>
+volatile uint8_t& fastOutputRegister() noexcept;
+template<FastPort port>
+volatile uint8_t& fastInputRegister() noexcept;
+#ifdef BONUSPIN_HAS_FAST_PINS
+template<> inline volatile uint8_t& fastOutputRegister<FastPort::B>() noexcept { return PORTB; }
+template<> inline volatile uint8_t& fastOutputRegister<FastPort::C>() noexcept { return PORTC; }
+template<> inline volatile uint8_t& fastOutputRegister<FastPort::D>() noexcept { return PORTD; }
+template<> inline volatile uint8_t& fastInputRegister<FastPort::B>() noexcept { return PINB; }
+template<> inline volatile uint8_t& fastInputRegister<FastPort::C>() noexcept { return PINC; }
+template<> inline volatile uint8_t& fastInputRegister<FastPort::D>() noexcept { return PIND; }
+#endif
+
+/**
+ * Static accessor for a digital pin known at compile time. When the pin
+ * mapping of the target is known, writes become a single sbi/cbi on the
+ * port register (which is also interrupt safe); otherwise the regular
+ * Arduino functions are used. The pin must already be configured with
+ * pinMode, this class never touches the direction register.
+ * @tparam pin the Arduino pin number
+ */
+template<int pin>
+struct FastPin final {
+    static constexpr auto Pin = pin;
+    static constexpr auto Port = fastPortOf(pin);
+    static constexpr byte Mask = static_cast<byte>(1 << fastBitOf(pin));
+    static constexpr bool Available = (Port != FastPort::None);
+    static void set() noexcept {
+        if constexpr (Available) {
+            fastOutputRegister<Port>() |= Mask;
+        } else {
+            ::digitalWrite(pin, HIGH);
+        }
+    }
+    static void clear() noexcept {
+        if constexpr (Available) {
+            fastOutputRegister<Port>() &= static_cast<byte>(~Mask);
+        } else {
+            ::digitalWrite(pin, LOW);
+        }
+    }
+    static void write(decltype(HIGH) value) noexcept {
+        if (value == LOW) {
+            clear();
+        } else {
+            set();
+        }
+    }
+    template<decltype(HIGH) value>
+    static void write() noexcept {
+        if constexpr (value == LOW) {
+            clear();
+        } else {
+            set();
+        }
+    }
+    static auto read() noexcept {
+        if constexpr (Available) {
+            return (fastInputRegister<Port>() & Mask) ? HIGH : LOW;
+        } else {
+            return ::digitalRead(pin);
+        }
+    }
+    FastPin() = delete;
+    ~FastPin() = delete;
+    FastPin(const FastPin&) = delete;
+    FastPin(FastPin&&) = delete;
+    FastPin& operator=(const FastPin&) = delete;
+    FastPin& operator=(FastPin&&) = delete;
+};
+
+/**
+ * DigitalPinHolder counterpart which writes through FastPin, for pins which
+ * are toggled in the middle of a time critical transfer.
+ * @tparam pin The pin to be held
+ * @tparam holdPinAs the value to hold the pin to during the lifetime of the object
+ * @tparam restorePinTo the value to return the pin to when this object goes out of scope.
+ */
+template<int pin, decltype(LOW) holdPinAs, decltype(HIGH) restorePinTo>
+class FastPinHolder final
+{
+    public:
+        FastPinHolder() {
+            if constexpr (pin >= 0) {
+                FastPin<pin>::template write<holdPinAs>();
+            }
+        }
+        ~FastPinHolder() {
+            if constexpr (pin >= 0) {
+                FastPin<pin>::template write<restorePinTo>();
+            }
+        }
+        inline constexpr decltype(pin) getPin() const noexcept { return pin; }
+        inline constexpr auto willNotFire() const noexcept { return pin < 0; }
+        FastPinHolder(const FastPinHolder&) = delete;
+        FastPinHolder(FastPinHolder&&) = delete;
+        FastPinHolder& operator=(const FastPinHolder&) = delete;
+        FastPinHolder& operator=(FastPinHolder&&) = delete;
+};
+
+template<int pin>
+using HoldFastPinLow = FastPinHolder<pin, LOW, HIGH>;
+template<int pin>
+using HoldFastPinHigh = FastPinHolder<pin, HIGH, LOW>;
+
+} // end namespace bonuspin
+#endif // end LIB_CORE_FASTPIN_H__
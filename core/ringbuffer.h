@@ -0,0 +1,91 @@
+/**
+ * @file
+ * Fixed capacity ring buffer for handing data from an interrupt handler to
+ * the main loop
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_CORE_RINGBUFFER_H__
+#define LIB_CORE_RINGBUFFER_H__
+#include "Arduino.h"
+namespace bonuspin
+{
+/**
+ * Lock free single producer, single consumer queue. One side (usually an
+ * interrupt handler) only calls push and the other only calls pop. The
+ * indices are single bytes so loading and storing them is atomic on every
+ * supported microcontroller; a compiler barrier keeps the element copy
+ * ordered with respect to the index update.
+ * @tparam T the element type, must be copyable
+ * @tparam capacity the number of elements, a power of two no larger than 128
+ */
+template<typename T, byte capacity>
+class SPSCRingBuffer final {
+    public:
+        static_assert(capacity > 0 && capacity <= 128, "Capacity must be between 1 and 128");
+        static_assert((capacity & (capacity - 1)) == 0, "Capacity must be a power of two");
+        static constexpr byte Capacity = capacity;
+    public:
+        SPSCRingBuffer() = default;
+        SPSCRingBuffer(const SPSCRingBuffer&) = delete;
+        SPSCRingBuffer(SPSCRingBuffer&&) = delete;
+        SPSCRingBuffer& operator=(const SPSCRingBuffer&) = delete;
+        SPSCRingBuffer& operator=(SPSCRingBuffer&&) = delete;
+        /**
+         * Producer side, returns false (dropping the value) when full
+         */
+        bool push(const T& value) noexcept {
+            byte head = _head;
+            if (static_cast<byte>(head - _tail) == Capacity) {
+                return false;
+            }
+            _storage[head & Mask] = value;
+            barrier();
+            _head = static_cast<byte>(head + 1);
+            return true;
+        }
+        /**
+         * Consumer side, returns false when there is nothing to take
+         */
+        bool pop(T& value) noexcept {
+            byte tail = _tail;
+            if (tail == _head) {
+                return false;
+            }
+            value = _storage[tail & Mask];
+            barrier();
+            _tail = static_cast<byte>(tail + 1);
+            return true;
+        }
+        byte size() const noexcept { return static_cast<byte>(_head - _tail); }
+        bool empty() const noexcept { return _head == _tail; }
+        bool full() const noexcept { return size() == Capacity; }
+    private:
+        static constexpr byte Mask = Capacity - 1;
+        static void barrier() noexcept {
+            asm volatile("" ::: "memory");
+        }
+    private:
+        T _storage[Capacity];
+        volatile byte _head = 0;
+        volatile byte _tail = 0;
+};
+
+} // end namespace bonuspin
+#endif // end LIB_CORE_RINGBUFFER_H__
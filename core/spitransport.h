@@ -0,0 +1,133 @@
+/**
+ * @file
+ * Interchangeable SPI transports so that devices can be moved between the
+ * hardware SPI peripheral and a bit-banged bus on any set of pins
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_CORE_SPITRANSPORT_H__
+#define LIB_CORE_SPITRANSPORT_H__
+#include "Arduino.h"
+#include <SPI.h>
+#include "fastpin.h"
+namespace bonuspin
+{
+/**
+ * The global hardware SPI object. Every transport provides the same set of
+ * static functions: begin, beginTransaction, transfer, endTransaction and
+ * usingInterrupt.
+ */
+struct HardwareSPITransport final {
+    /// SPI.usingInterrupt keeps a handler out of an active transaction
+    static constexpr bool CanTransferInInterrupt = true;
+    static void begin() noexcept {
+        SPI.begin();
+    }
+    static void beginTransaction(const SPISettings& settings) noexcept {
+        SPI.beginTransaction(settings);
+    }
+    static byte transfer(byte value) noexcept {
+        return SPI.transfer(static_cast<uint8_t>(value));
+    }
+    static void endTransaction() noexcept {
+        SPI.endTransaction();
+    }
+    static void usingInterrupt(int interruptNumber) noexcept {
+        SPI.usingInterrupt(interruptNumber);
+    }
+    HardwareSPITransport() = delete;
+    ~HardwareSPITransport() = delete;
+    HardwareSPITransport(const HardwareSPITransport&) = delete;
+    HardwareSPITransport(HardwareSPITransport&&) = delete;
+    HardwareSPITransport& operator=(const HardwareSPITransport&) = delete;
+    HardwareSPITransport& operator=(HardwareSPITransport&&) = delete;
+};
+
+/**
+ * Bit-banged SPI mode 0, most significant bit first. Each byte is fully
+ * unrolled and every pin access goes through FastPin so on boards with a
+ * known pin mapping a bit costs a handful of single cycle port operations.
+ * The clock rate is whatever the code runs at, SPISettings are ignored.
+ * @tparam sck the clock pin
+ * @tparam mosi the data out pin
+ * @tparam miso the data in pin, negative for a write only bus
+ */
+template<int sck, int mosi, int miso = -1>
+struct SoftwareSPITransport final {
+    static_assert(sck >= 0, "The clock must be bound to a real pin!");
+    static_assert(mosi >= 0, "Data out must be bound to a real pin!");
+    static constexpr auto ClockPin = sck;
+    static constexpr auto DataOutPin = mosi;
+    static constexpr auto DataInPin = miso;
+    static constexpr bool HasDataIn = (DataInPin >= 0);
+    /// there is nothing to stop a handler from clocking in the middle of a
+    /// transfer made by the main loop
+    static constexpr bool CanTransferInInterrupt = false;
+    static void begin() noexcept {
+        ::pinMode(ClockPin, OUTPUT);
+        ::digitalWrite(ClockPin, LOW);
+        ::pinMode(DataOutPin, OUTPUT);
+        if constexpr (HasDataIn) {
+            ::pinMode(DataInPin, INPUT);
+        }
+    }
+    static void beginTransaction(const SPISettings&) noexcept { }
+    static byte transfer(byte value) noexcept {
+        byte result = 0;
+        transferBit<7>(value, result);
+        transferBit<6>(value, result);
+        transferBit<5>(value, result);
+        transferBit<4>(value, result);
+        transferBit<3>(value, result);
+        transferBit<2>(value, result);
+        transferBit<1>(value, result);
+        transferBit<0>(value, result);
+        return result;
+    }
+    static void endTransaction() noexcept { }
+    static void usingInterrupt(int) noexcept { }
+    SoftwareSPITransport() = delete;
+    ~SoftwareSPITransport() = delete;
+    SoftwareSPITransport(const SoftwareSPITransport&) = delete;
+    SoftwareSPITransport(SoftwareSPITransport&&) = delete;
+    SoftwareSPITransport& operator=(const SoftwareSPITransport&) = delete;
+    SoftwareSPITransport& operator=(SoftwareSPITransport&&) = delete;
+    private:
+        template<byte bit>
+        static void transferBit(byte value, byte& result) noexcept {
+            constexpr byte mask = static_cast<byte>(1 << bit);
+            // data is set up while the clock is low and sampled on the
+            // rising edge
+            if (value & mask) {
+                FastPin<DataOutPin>::set();
+            } else {
+                FastPin<DataOutPin>::clear();
+            }
+            FastPin<ClockPin>::set();
+            if constexpr (HasDataIn) {
+                if (FastPin<DataInPin>::read() != LOW) {
+                    result |= mask;
+                }
+            }
+            FastPin<ClockPin>::clear();
+        }
+};
+
+} // end namespace bonuspin
+#endif // end LIB_CORE_SPITRANSPORT_H__
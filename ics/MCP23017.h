@@ -0,0 +1,86 @@
+/**
+ * @file
+ * header only implementation for interfacing with the mcp23017 digital io
+ * expander chip which operates over i2c
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23017_H__
+#define LIB_ICS_MCP23017_H__
+#include "Arduino.h"
+#include <Wire.h>
+#include "MCP23x17.h"
+namespace bonuspin
+{
+/**
+ * MCP23017 on the global Wire bus, sharing every register level operation
+ * with the MCP23S17. A write frame is a single transmission holding the
+ * register address followed by the data; a read writes the register address,
+ * issues a repeated start and then reads every requested byte so that a
+ * 16-bit register pair (or INTF and INTCAP together) is one bus transaction.
+ * Wire.begin() must be called before begin(). The A2:A0 pins are always
+ * used by the I2C part, IOCON.HAEN has no effect on it.
+ */
+template<byte address, int resetPin = -1, bool shadowRegisters = false, typename IOConfiguration = MCP23x17RuntimeConfiguration>
+class MCP23017 : public MCP23x17Core<MCP23017<address, resetPin, shadowRegisters, IOConfiguration>, address, resetPin, shadowRegisters, IOConfiguration> {
+    public:
+        using Parent = MCP23x17Core<MCP23017<address, resetPin, shadowRegisters, IOConfiguration>, address, resetPin, shadowRegisters, IOConfiguration>;
+        using Self = MCP23017<address, resetPin, shadowRegisters, IOConfiguration>;
+        friend Parent;
+        /// 7-bit bus address, 0100 A2 A1 A0
+        static constexpr byte DeviceAddress = 0b010'0000 | address;
+        /// the smallest Wire buffer is 32 bytes and a write also holds the
+        /// register address
+        static constexpr byte MaxBurstLength = 31;
+        /// Wire depends on interrupts itself so it cannot be used from a handler
+        static constexpr bool CanTransferInInterrupt = false;
+        constexpr auto getDeviceAddress() const noexcept { return DeviceAddress; }
+        MCP23017() = default;
+        ~MCP23017() = default;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        MCP23017(const Self&) = delete;
+        MCP23017(Self&&) = delete;
+    private:
+        void acquireBus() noexcept { }
+        void releaseBus() noexcept { }
+        void beginWrite(byte registerAddress) noexcept {
+            Wire.beginTransmission(DeviceAddress);
+            Wire.write(static_cast<uint8_t>(registerAddress));
+        }
+        void writeByte(byte value) noexcept {
+            Wire.write(static_cast<uint8_t>(value));
+        }
+        void endWrite() noexcept {
+            Wire.endTransmission();
+        }
+        void readRegisters(byte registerAddress, byte* values, byte count) noexcept {
+            Wire.beginTransmission(DeviceAddress);
+            Wire.write(static_cast<uint8_t>(registerAddress));
+            // keep the bus so the read follows with a repeated start
+            Wire.endTransmission(false);
+            Wire.requestFrom(static_cast<uint8_t>(DeviceAddress), static_cast<uint8_t>(count));
+            for (byte i = 0; i < count; ++i) {
+                values[i] = static_cast<byte>(Wire.read());
+            }
+        }
+};
+
+} // end namespace bonuspin
+#endif // end LIB_ICS_MCP23017_H__
@@ -0,0 +1,1142 @@
+/**
+ * @file
+ * Transport independent register core shared by the MCP23S17 (SPI) and the
+ * MCP23017 (I2C) digital io expanders
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23X17_H__
+#define LIB_ICS_MCP23X17_H__
+#include "Arduino.h"
+#include "../core/concepts.h"
+namespace bonuspin 
+{
+/**
+ * One of the two 8-bit ports of a MCP23x17
+ */
+enum class MCP23x17Port : byte {
+    A,
+    B,
+};
+/**
+ * Copy of the entire register file of a MCP23x17, always laid out in the
+ * BANK = 0 order (IODIRA, IODIRB, IPOLA, ... OLATA, OLATB) regardless of the
+ * bank mode of the chip it came from.
+ */
+struct MCP23x17Snapshot final {
+    static constexpr byte RegisterCount = 22;
+    byte registers[RegisterCount];
+};
+/**
+ * Describes which pins of a MCP23x17 raise an interrupt and when, as the
+ * GPINTEN, DEFVAL and INTCON words. Every function returns an updated copy
+ * so a configuration can be chained together and evaluated at compile time:
+ *
+ *     constexpr auto buttons = MCP23x17InterruptConfiguration{}.onFalling(0x00FF).onChange(0x0100);
+ *
+ * Later calls override earlier ones for the pins they name. The chip only
+ * knows "differs from the previous value" and "differs from DEFVAL", so
+ * onRising and onFalling are level conditions: the interrupt fires again
+ * after being cleared for as long as the pin stays at the new level.
+ */
+class MCP23x17InterruptConfiguration final {
+    public:
+        using Self = MCP23x17InterruptConfiguration;
+        constexpr MCP23x17InterruptConfiguration() noexcept = default;
+        /// interrupt whenever the pins change in either direction
+        constexpr Self onChange(uint16_t pins) const noexcept { return Self(_enable | pins, _compare & ~pins, _control & ~pins); }
+        /// interrupt while the pins are high
+        constexpr Self onRising(uint16_t pins) const noexcept { return onCompare(pins, 0x0000); }
+        /// interrupt while the pins are low
+        constexpr Self onFalling(uint16_t pins) const noexcept { return onCompare(pins, 0xFFFF); }
+        /// interrupt while the pins differ from the matching bits of value
+        constexpr Self onCompare(uint16_t pins, uint16_t value) const noexcept { return Self(_enable | pins, (_compare & ~pins) | (value & pins), _control | pins); }
+        /// do not raise interrupts for the pins
+        constexpr Self disable(uint16_t pins) const noexcept { return Self(_enable & ~pins, _compare & ~pins, _control & ~pins); }
+        constexpr uint16_t getInterruptEnable() const noexcept { return _enable; }
+        constexpr uint16_t getDefaultCompare() const noexcept { return _compare; }
+        constexpr uint16_t getInterruptControl() const noexcept { return _control; }
+    private:
+        constexpr MCP23x17InterruptConfiguration(uint16_t enable, uint16_t compare, uint16_t control) noexcept : _enable(enable), _compare(compare), _control(control) { }
+    private:
+        uint16_t _enable = 0;
+        uint16_t _compare = 0;
+        uint16_t _control = 0;
+};
+/**
+ * The registers of a MCP23x17 which hold configuration or output state and
+ * can therefore be mirrored in memory.
+ */
+enum class MCP23x17ShadowedRegister : byte {
+    IODIR,
+    IPOL,
+    GPINTEN,
+    DEFVAL,
+    INTCON,
+    GPPU,
+    OLAT,
+    Count,
+};
+/**
+ * Write-through copy of the configuration and output latch registers of a
+ * MCP23x17. Each entry holds the A register in the lower byte and the B
+ * register in the upper byte, starting at the power on reset values.
+ * @tparam enabled when false nothing is mirrored
+ */
+template<bool enabled>
+struct MCP23x17RegisterShadow final {
+    uint16_t get(MCP23x17ShadowedRegister which) const noexcept { return _registers[static_cast<byte>(which)]; }
+    void set(MCP23x17ShadowedRegister which, uint16_t value) noexcept { _registers[static_cast<byte>(which)] = value; }
+    private:
+        uint16_t _registers[static_cast<byte>(MCP23x17ShadowedRegister::Count)] = { 0xFFFF, 0, 0, 0, 0, 0, 0, };
+};
+template<>
+struct MCP23x17RegisterShadow<false> final { };
+
+/**
+ * Marks a MCP23x17 whose IOCON register is changed at runtime through
+ * setIOCon and the helpers built on top of it (the default).
+ */
+struct MCP23x17RuntimeConfiguration final {
+    static constexpr bool IsStatic = false;
+};
+/**
+ * Fixed IOCON configuration of a MCP23x17. begin() writes it to the chip
+ * once and every register address becomes a compile time constant for the
+ * selected bank mode. The chip must be in its power on state when begin() is
+ * called (begin() pulses RESET when it is connected).
+ * @tparam banked BANK, registers of each port are grouped together
+ * @tparam mirrored MIRROR, INTA and INTB are internally connected
+ * @tparam sequentialOperation the address pointer increments (SEQOP clear)
+ * @tparam slewRateControl SDA slew rate control (DISSLW clear)
+ * @tparam hardwareAddressing HAEN, the A2:A0 pins are used
+ * @tparam openDrain ODR, the interrupt lines are open drain
+ * @tparam activeHigh INTPOL, the interrupt lines are active high
+ */
+template<bool banked = false,
+         bool mirrored = false,
+         bool sequentialOperation = true,
+         bool slewRateControl = true,
+         bool hardwareAddressing = false,
+         bool openDrain = false,
+         bool activeHigh = false>
+struct MCP23x17Configuration final {
+    static constexpr bool IsStatic = true;
+    static constexpr bool Banked = banked;
+    static constexpr bool Mirrored = mirrored;
+    static constexpr bool SequentialOperation = sequentialOperation;
+    static constexpr bool SlewRateControl = slewRateControl;
+    static constexpr bool HardwareAddressing = hardwareAddressing;
+    static constexpr bool OpenDrain = openDrain;
+    static constexpr bool ActiveHigh = activeHigh;
+    static constexpr byte Value = (banked ? 0b1000'0000 : 0) |
+                                  (mirrored ? 0b0100'0000 : 0) |
+                                  (sequentialOperation ? 0 : 0b0010'0000) |
+                                  (slewRateControl ? 0 : 0b0001'0000) |
+                                  (hardwareAddressing ? 0b0000'1000 : 0) |
+                                  (openDrain ? 0b0000'0100 : 0) |
+                                  (activeHigh ? 0b0000'0010 : 0);
+};
+
+/**
+ * Common implementation of the MCP23x17 family. Moving bytes to and from the
+ * chip is statically dispatched to Derived so that the register map and
+ * every operation built on top of it are shared by the SPI and I2C parts.
+ * Derived must provide (and may keep private if it befriends this class):
+ *  - MaxBurstLength, the largest number of register bytes in one frame
+ *  - acquireBus() / releaseBus(), bracket a run of frames
+ *  - beginWrite(reg), writeByte(value), endWrite(), one write frame
+ *  - readRegisters(reg, values, count), one complete read frame
+ * @tparam Derived the concrete device type (CRTP)
+ * @tparam address the hardware address of the chip (A2:A0)
+ * @tparam resetPin the pin connected to RESET, negative when not connected
+ * @tparam shadowRegisters keep a write-through copy of the configuration and
+ * output latch registers so that reading them and changing single pins does
+ * not require reading from the chip first.
+ * @tparam IOConfiguration MCP23x17RuntimeConfiguration or a fixed
+ * MCP23x17Configuration
+ */
+template<typename Derived, byte address, int resetPin = -1, bool shadowRegisters = false, typename IOConfiguration = MCP23x17RuntimeConfiguration>
+class MCP23x17Core {
+    public:
+        static_assert((address & 0b111) == address, "Provided address is too large!");
+    private:
+        static constexpr auto generateByte(bool a, bool b, bool c, bool d, bool e, bool f, bool g, bool h) noexcept {
+            byte output = 0;
+            output |= (a ? 0b0000'0001 : 0);
+            output |= (b ? 0b0000'0010 : 0);
+            output |= (c ? 0b0000'0100 : 0);
+            output |= (d ? 0b0000'1000 : 0);
+            output |= (e ? 0b0001'0000 : 0);
+            output |= (f ? 0b0010'0000 : 0);
+            output |= (g ? 0b0100'0000 : 0);
+            output |= (h ? 0b1000'0000 : 0);
+            return output;
+        }
+        static constexpr auto generateIOConByte(bool intPolarity, bool odr, bool haen, bool disslw, bool seqop, bool mirror, bool bank) noexcept {
+            return generateByte(false, intPolarity, odr, haen, disslw, seqop, mirror, bank);
+        }
+    public:
+        using Self = MCP23x17Core<Derived, address, resetPin, shadowRegisters, IOConfiguration>;
+        using Configuration = IOConfiguration;
+        using ShadowedRegister = MCP23x17ShadowedRegister;
+        using Snapshot = MCP23x17Snapshot;
+        using InterruptConfiguration = MCP23x17InterruptConfiguration;
+        static constexpr auto BusAddress = address;
+        static constexpr auto ResetPin = resetPin;
+        static constexpr auto HasResetPin = (ResetPin >= 0);
+        static constexpr auto ShadowRegisters = shadowRegisters;
+        static constexpr auto HasStaticConfiguration = Configuration::IsStatic;
+        constexpr auto getSPIAddress() const noexcept { return (hardwareAddressEnabled() && !_usingPowerOnAddress) ? BusAddress : 0b000; }
+        constexpr auto getResetPin() const noexcept { return ResetPin; }
+        constexpr auto hasResetPin() const noexcept { return ResetPin >= 0; }
+    protected:
+        MCP23x17Core() = default;
+        ~MCP23x17Core() = default;
+    public:
+        Self& operator=(const Self&) = delete; 
+        Self& operator=(Self&&) = delete; 
+        MCP23x17Core(const Self&) = delete;
+        MCP23x17Core(Self&&) = delete;
+        void begin() noexcept {
+            if constexpr (HasResetPin) {
+                ::pinMode(ResetPin, OUTPUT);
+                ::digitalWrite(ResetPin, HIGH);
+            }
+            // on startup registers are sequential, you must actually change
+            // the iocon register. Polarity is also active low for interrupt
+            // lines
+            if constexpr (HasStaticConfiguration) {
+                if constexpr (HasResetPin) {
+                    reset();
+                } else {
+                    applyStaticConfiguration();
+                }
+            }
+            if constexpr (ShadowRegisters) {
+                resync();
+            }
+        }
+    private:
+        Derived& derived() noexcept { return static_cast<Derived&>(*this); }
+        /**
+         * Write the fixed configuration to IOCON, which is always at 0x0A
+         * after a power on reset. HAEN is still clear at that point so the
+         * chip only answers to address 000, whatever its address pins say.
+         */
+        void applyStaticConfiguration() noexcept {
+            static_assert(HasStaticConfiguration, "Only fixed configurations can be applied");
+            _usingPowerOnAddress = true;
+            write(0x0A, Configuration::Value);
+            // nothing else may share the frame sent to address 000
+            closeOpenWrite();
+            _usingPowerOnAddress = false;
+        }
+        static constexpr byte NoOpenWrite = 0xFF;
+        /**
+         * True when the transport cannot take an arbitrarily long frame
+         * (the Wire buffer for example) so bursts have to be split up.
+         */
+        static constexpr bool burstsAreLimited() noexcept { return Derived::MaxBurstLength < 0xFF; }
+        void beginBusAccess() noexcept {
+            if (_batchDepth == 0) {
+                derived().acquireBus();
+            }
+        }
+        void endBusAccess() noexcept {
+            if (_batchDepth == 0) {
+                derived().releaseBus();
+            }
+        }
+        /**
+         * Finish the write frame a batch left open, if any.
+         */
+        void closeOpenWrite() noexcept {
+            if (_openWriteAddress != NoOpenWrite) {
+                derived().endWrite();
+                _openWriteAddress = NoOpenWrite;
+            }
+        }
+        /**
+         * Where the address pointer of the chip ends up after count bytes
+         * have been written starting at registerAddress, NoOpenWrite if it
+         * would leave the register file.
+         */
+        constexpr byte addressAfter(byte registerAddress, byte count) const noexcept {
+            if (sequentialOperationEnabled()) {
+                auto next = registerAddress + count;
+                if (registersAreSequential()) {
+                    return next <= 0x15 ? static_cast<byte>(next) : NoOpenWrite;
+                } else {
+                    return (((next & 0xF0) == (registerAddress & 0xF0)) && ((next & 0x0F) <= 0x0A)) ? static_cast<byte>(next) : NoOpenWrite;
+                }
+            } else if (registersAreSequential()) {
+                // byte mode with BANK = 0 toggles between the A and B halves
+                return (count & 1) ? (registerAddress ^ 1) : registerAddress;
+            } else {
+                return registerAddress;
+            }
+        }
+
+        byte read(byte registerAddress) noexcept {
+            byte result = 0;
+            readBurst(registerAddress, &result, 1);
+            return result;
+        }
+        void write(byte registerAddress, byte value) noexcept {
+            writeBurst(registerAddress, &value, 1);
+        }
+        /**
+         * Read count consecutive registers in a single transaction starting
+         * at registerAddress. How the address pointer moves between bytes is
+         * controlled by IOCON.BANK and IOCON.SEQOP.
+         */
+        void readBurst(byte registerAddress, byte* values, byte count) noexcept {
+            closeOpenWrite();
+            beginBusAccess();
+            if constexpr (burstsAreLimited()) {
+                while (count > Derived::MaxBurstLength) {
+                    derived().readRegisters(registerAddress, values, Derived::MaxBurstLength);
+                    registerAddress = addressAfter(registerAddress, Derived::MaxBurstLength);
+                    values += Derived::MaxBurstLength;
+                    count -= Derived::MaxBurstLength;
+                }
+            }
+            derived().readRegisters(registerAddress, values, count);
+            endBusAccess();
+        }
+        /**
+         * Write count consecutive registers in a single transaction starting
+         * at registerAddress. Inside of a batch the transaction is left open
+         * so that a following write to the register the address pointer now
+         * refers to is appended to it instead of starting a new one.
+         */
+        void writeBurst(byte registerAddress, const byte* values, byte count) noexcept {
+            if constexpr (burstsAreLimited()) {
+                while (count > 0) {
+                    byte room = Derived::MaxBurstLength;
+                    if (_openWriteAddress == registerAddress) {
+                        room -= _openWriteLength;
+                        if (room == 0) {
+                            closeOpenWrite();
+                            room = Derived::MaxBurstLength;
+                        }
+                    }
+                    byte chunk = (count < room) ? count : room;
+                    writeFrame(registerAddress, values, chunk);
+                    registerAddress = addressAfter(registerAddress, chunk);
+                    values += chunk;
+                    count -= chunk;
+                }
+            } else {
+                writeFrame(registerAddress, values, count);
+            }
+        }
+        void writeFrame(byte registerAddress, const byte* values, byte count) noexcept {
+            if (_openWriteAddress != registerAddress) {
+                closeOpenWrite();
+                beginBusAccess();
+                derived().beginWrite(registerAddress);
+                _openWriteLength = 0;
+            }
+            for (byte i = 0; i < count; ++i) {
+                derived().writeByte(values[i]);
+            }
+            if (_batchDepth > 0) {
+                _openWriteAddress = addressAfter(registerAddress, count);
+                _openWriteLength += count;
+                if (_openWriteAddress == NoOpenWrite) {
+                    derived().endWrite();
+                }
+            } else {
+                derived().endWrite();
+                endBusAccess();
+            }
+        }
+        /**
+         * With IOCON.BANK = 0 the A and B registers of a pair are adjacent
+         * and the address pointer moves from A to B after the first byte
+         * (incrementing when SEQOP is enabled, toggling within the pair when
+         * it is disabled) so both halves can be moved in one transaction.
+         */
+        constexpr bool canBurstPair(byte registerAddressA, byte registerAddressB) const noexcept {
+            return registersAreSequential() && (registerAddressB == (registerAddressA + 1));
+        }
+        void write16(byte registerAddressA, byte registerAddressB, uint16_t value) noexcept {
+            if (canBurstPair(registerAddressA, registerAddressB)) {
+                byte values[2] = { static_cast<byte>(value & 0xFF), static_cast<byte>((value & 0xFF00) >> 8) };
+                writeBurst(registerAddressA, values, 2);
+            } else {
+                write(registerAddressA, static_cast<byte>(value & 0xFF));
+                write(registerAddressB, static_cast<byte>((value & 0xFF00) >> 8));
+            }
+        }
+        uint16_t read16(byte registerAddressA, byte registerAddressB) noexcept {
+            if (canBurstPair(registerAddressA, registerAddressB)) {
+                byte values[2] = { 0 };
+                readBurst(registerAddressA, values, 2);
+                return static_cast<uint16_t>(values[0]) | (static_cast<uint16_t>(values[1]) << 8);
+            } else {
+                return static_cast<uint16_t>(read(registerAddressA)) |
+                       (static_cast<uint16_t>(read(registerAddressB)) << 8);
+            }
+        }
+        uint16_t readShadowed16(ShadowedRegister which, byte registerAddressA, byte registerAddressB) noexcept {
+            if constexpr (ShadowRegisters) {
+                return _shadow.get(which);
+            } else {
+                return read16(registerAddressA, registerAddressB);
+            }
+        }
+        void writeShadowed16(ShadowedRegister which, byte registerAddressA, byte registerAddressB, uint16_t value) noexcept {
+            write16(registerAddressA, registerAddressB, value);
+            if constexpr (ShadowRegisters) {
+                _shadow.set(which, value);
+            }
+        }
+        /**
+         * Write back only the halves of the given register pair which are
+         * covered by mask; the bits outside of the mask are assumed to
+         * already be in value. Touching a single port costs one 8-bit write.
+         */
+        void writeShadowedMasked(ShadowedRegister which, byte registerAddressA, byte registerAddressB, uint16_t mask, uint16_t value) noexcept {
+            if ((mask & 0xFF00) == 0) {
+                if (mask == 0) {
+                    return;
+                }
+                write(registerAddressA, static_cast<byte>(value & 0xFF));
+            } else if ((mask & 0x00FF) == 0) {
+                write(registerAddressB, static_cast<byte>((value & 0xFF00) >> 8));
+            } else {
+                write16(registerAddressA, registerAddressB, value);
+            }
+            if constexpr (ShadowRegisters) {
+                _shadow.set(which, value);
+            }
+        }
+        void writeOutputLatchMasked(uint16_t mask, uint16_t value) noexcept {
+            writeShadowedMasked(ShadowedRegister::OLAT, getOLATAAddress(), getOLATBAddress(), mask, value);
+        }
+        template<byte seq, byte banked>
+        constexpr byte chooseAddress() const noexcept {
+            return registersAreSequential() ? seq : banked;
+        }
+        constexpr auto getIODIRAAddress()   const noexcept { return 0x00; }
+        constexpr auto getIODIRBAddress()   const noexcept { return chooseAddress<0x01, 0x10>(); }
+        constexpr auto getIOPOLAAddress()   const noexcept { return chooseAddress<0x02, 0x01>(); }
+        constexpr auto getIOPOLBAddress()   const noexcept { return chooseAddress<0x03, 0x11>(); }
+        constexpr auto getGPINTENAAddress() const noexcept { return chooseAddress<0x04, 0x02>(); }
+        constexpr auto getGPINTENBAddress() const noexcept { return chooseAddress<0x05, 0x12>(); }
+        constexpr auto getDEFVALAAddress()  const noexcept { return chooseAddress<0x06, 0x03>(); }
+        constexpr auto getDEFVALBAddress()  const noexcept { return chooseAddress<0x07, 0x13>(); }
+        constexpr auto getIntConAAddress()  const noexcept { return chooseAddress<0x08, 0x04>(); }
+        constexpr auto getIntConBAddress()  const noexcept { return chooseAddress<0x09, 0x14>(); }
+        constexpr auto getIOConAddress()    const noexcept { return chooseAddress<0x0A, 0x05>(); }
+        constexpr auto getGPPUAAddress()    const noexcept { return chooseAddress<0x0C, 0x06>(); }
+        constexpr auto getGPPUBAddress()    const noexcept { return chooseAddress<0x0D, 0x16>(); }
+        constexpr auto getINTFAAddress()    const noexcept { return chooseAddress<0x0E, 0x07>(); }
+        constexpr auto getINTFBAddress()    const noexcept { return chooseAddress<0x0F, 0x17>(); }
+        constexpr auto getINTCAPAAddress()  const noexcept { return chooseAddress<0x10, 0x08>(); }
+        constexpr auto getINTCAPBAddress()  const noexcept { return chooseAddress<0x11, 0x18>(); }
+        constexpr auto getGPIOAAddress()    const noexcept { return chooseAddress<0x12, 0x09>(); }
+        constexpr auto getGPIOBAddress()    const noexcept { return chooseAddress<0x13, 0x19>(); }
+        constexpr auto getOLATAAddress()    const noexcept { return chooseAddress<0x14, 0x0A>(); }
+        constexpr auto getOLATBAddress()    const noexcept { return chooseAddress<0x15, 0x1A>(); }
+    public:
+        constexpr bool registersAreInSeparateBanks() const noexcept { return !registersAreSequential(); }
+        constexpr bool registersAreSequential() const noexcept {
+            if constexpr (HasStaticConfiguration) {
+                return !Configuration::Banked;
+            } else {
+                return _registersAreSequential;
+            }
+        }
+        constexpr bool interruptPinsAreActiveLow() const noexcept {
+            if constexpr (HasStaticConfiguration) {
+                return !Configuration::ActiveHigh;
+            } else {
+                return _polarityIsActiveLow;
+            }
+        }
+        constexpr bool interruptPinsAreActiveHigh() const noexcept { return !interruptPinsAreActiveLow(); }
+        constexpr bool hardwareAddressEnabled() const noexcept {
+            if constexpr (HasStaticConfiguration) {
+                return Configuration::HardwareAddressing;
+            } else {
+                return _hardwareAddressPinsEnabled;
+            }
+        }
+        constexpr bool hardwareAddressDisabled() const noexcept { return !hardwareAddressEnabled(); }
+        void refreshIOCon() noexcept {
+            updateIOConFlags(getIOCon());
+        }
+        byte getIOCon() noexcept { return read(getIOConAddress()); }
+        void setIOCon(byte value) noexcept {
+            static_assert(!HasStaticConfiguration, "IOCON is fixed by the configuration of this device");
+            // the bus (and with it any interrupt handler using this device)
+            // is only released once the flags match the chip again
+            BatchHolder batch(*this);
+            write(getIOConAddress(), value);
+            // the address pointer behaves differently from now on
+            closeOpenWrite();
+            // reading back is not an option since changing BANK moves IOCON
+            // itself, the value just written is authoritative
+            updateIOConFlags(value);
+        }
+        constexpr bool sequentialOperationEnabled() const noexcept {
+            if constexpr (HasStaticConfiguration) {
+                return Configuration::SequentialOperation;
+            } else {
+                return _sequentialOperationEnabled;
+            }
+        }
+        /**
+         * RAII-style scope which keeps the bus transaction of a device open
+         * for its lifetime. Register writes made while it is alive are
+         * appended to the previous write transaction whenever they target
+         * the register the address pointer already refers to, so
+         * reconfiguring consecutive registers costs a single chip select.
+         * Reads are still performed immediately. Other devices on the same
+         * bus must not be touched while a batch is alive.
+         */
+        class BatchHolder final {
+            public:
+                explicit BatchHolder(Self& device) noexcept : _device(device) { _device.beginBatch(); }
+                ~BatchHolder() { _device.endBatch(); }
+                BatchHolder(const BatchHolder&) = delete;
+                BatchHolder(BatchHolder&&) = delete;
+                BatchHolder& operator=(const BatchHolder&) = delete;
+                BatchHolder& operator=(BatchHolder&&) = delete;
+            private:
+                Self& _device;
+        };
+        void beginBatch() noexcept {
+            if (_batchDepth++ == 0) {
+                derived().acquireBus();
+            }
+        }
+        void endBatch() noexcept {
+            if (--_batchDepth == 0) {
+                closeOpenWrite();
+                derived().releaseBus();
+            }
+        }
+        void makeRegistersSequential() noexcept {
+            if (!registersAreSequential()) {
+                setIOCon(getIOCon() & 0b0111'1110);
+            }
+        }
+        void makeRegistersBanked() noexcept {
+            if (registersAreSequential()) {
+                setIOCon(getIOCon() | 0b1000'0000);
+            }
+        }
+        void makeInterruptOutputLinesActiveLow() noexcept {
+            if (!interruptPinsAreActiveLow()) {
+                setIOCon(getIOCon() & 0b0111'1100);
+            }
+        }
+        void makeInterruptOutputLinesActiveHigh() noexcept {
+            if (interruptPinsAreActiveLow()) {
+                setIOCon(getIOCon() | 0b0000'0010);
+            }
+        }
+        void reset() noexcept {
+            // always delay for 2 microseconds even if reset is not actually
+            // connected to a pin for consistency
+            {
+                volatile HoldPinLow<resetPin> holder;
+                delayMicroseconds(2);
+            }
+            if constexpr (HasResetPin) {
+                // the chip is now back at its power on values
+                if constexpr (ShadowRegisters) {
+                    _shadow = MCP23x17RegisterShadow<ShadowRegisters>{};
+                }
+                if constexpr (HasStaticConfiguration) {
+                    applyStaticConfiguration();
+                } else {
+                    updateIOConFlags(0);
+                }
+            }
+        }
+        uint16_t readGPIOs() noexcept { return read16(getGPIOAAddress(), getGPIOBAddress()); }
+        void writeGPIOs(uint16_t pattern) noexcept { writeShadowed16(ShadowedRegister::OLAT, getGPIOAAddress(), getGPIOBAddress(), pattern); }
+
+        uint16_t readGPIOsDirection() noexcept { return readShadowed16(ShadowedRegister::IODIR, getIODIRAAddress(), getIODIRBAddress()); }
+        void writeGPIOsDirection(uint16_t pattern) noexcept { writeShadowed16(ShadowedRegister::IODIR, getIODIRAAddress(), getIODIRBAddress(), pattern); }
+
+        uint16_t readGPIOPolarity() noexcept { return readShadowed16(ShadowedRegister::IPOL, getIOPOLAAddress(), getIOPOLBAddress()); }
+        void writeGPIOPolarity(uint16_t pattern) noexcept { writeShadowed16(ShadowedRegister::IPOL, getIOPOLAAddress(), getIOPOLBAddress(), pattern); }
+
+        uint16_t readGPIOInterruptEnable() noexcept { return readShadowed16(ShadowedRegister::GPINTEN, getGPINTENAAddress(), getGPINTENBAddress()); }
+        void writeGPIOInterruptEnable(uint16_t pattern) noexcept { writeShadowed16(ShadowedRegister::GPINTEN, getGPINTENAAddress(), getGPINTENBAddress(), pattern); }
+
+        uint16_t readDefaultCompareRegisterForInterruptOnChange() noexcept { return readShadowed16(ShadowedRegister::DEFVAL, getDEFVALAAddress(), getDEFVALBAddress()); }
+        void writeDefaultCompareRegisterForInterruptOnChange(uint16_t pattern) noexcept { writeShadowed16(ShadowedRegister::DEFVAL, getDEFVALAAddress(), getDEFVALBAddress(), pattern); }
+
+        uint16_t readInterruptOnChangeControlRegister() noexcept { return readShadowed16(ShadowedRegister::INTCON, getIntConAAddress(), getIntConBAddress()); }
+        void writeInterruptOnChangeControlRegister(uint16_t pattern) noexcept { writeShadowed16(ShadowedRegister::INTCON, getIntConAAddress(), getIntConBAddress(), pattern); }
+
+        uint16_t readGPIOPullup() noexcept { return readShadowed16(ShadowedRegister::GPPU, getGPPUAAddress(), getGPPUBAddress()); }
+        void writeGPIOPullup(uint16_t pattern) noexcept { writeShadowed16(ShadowedRegister::GPPU, getGPPUAAddress(), getGPPUBAddress(), pattern); }
+        uint16_t readGPIOInterruptFlags() noexcept { return read16(getINTFAAddress(), getINTFBAddress()); }
+        uint16_t readGPIOInterruptCapturedRegister() noexcept { return read16(getINTCAPAAddress(), getINTCAPBAddress()); }
+        /**
+         * Read INTF followed by INTCAP (which clears the pending interrupt).
+         * With BANK = 0 and SEQOP enabled the four registers are adjacent and
+         * are read in a single transaction.
+         */
+        void readGPIOInterruptFlagsAndCapture(uint16_t& flags, uint16_t& captured) noexcept {
+            if (registersAreSequential() && sequentialOperationEnabled()) {
+                byte values[4] = { 0 };
+                readBurst(getINTFAAddress(), values, 4);
+                flags = static_cast<uint16_t>(values[0]) | (static_cast<uint16_t>(values[1]) << 8);
+                captured = static_cast<uint16_t>(values[2]) | (static_cast<uint16_t>(values[3]) << 8);
+            } else {
+                flags = readGPIOInterruptFlags();
+                captured = readGPIOInterruptCapturedRegister();
+            }
+        }
+        /**
+         * Write GPINTEN, DEFVAL and INTCON. With BANK = 0 and SEQOP enabled
+         * the six registers are adjacent and this is a single burst. The
+         * burst has to write GPINTEN first so a change caught while the rest
+         * is written may still be latched; read INTCAP afterwards to start
+         * from a clean slate.
+         */
+        void applyInterruptConfiguration(const InterruptConfiguration& config) noexcept {
+            auto enable = config.getInterruptEnable();
+            auto compare = config.getDefaultCompare();
+            auto control = config.getInterruptControl();
+            if (registersAreSequential() && sequentialOperationEnabled()) {
+                byte values[6] = {
+                    static_cast<byte>(enable & 0xFF), static_cast<byte>(enable >> 8),
+                    static_cast<byte>(compare & 0xFF), static_cast<byte>(compare >> 8),
+                    static_cast<byte>(control & 0xFF), static_cast<byte>(control >> 8),
+                };
+                writeBurst(getGPINTENAAddress(), values, 6);
+                if constexpr (ShadowRegisters) {
+                    _shadow.set(ShadowedRegister::GPINTEN, enable);
+                    _shadow.set(ShadowedRegister::DEFVAL, compare);
+                    _shadow.set(ShadowedRegister::INTCON, control);
+                }
+            } else {
+                BatchHolder batch(*this);
+                writeShadowed16(ShadowedRegister::DEFVAL, getDEFVALAAddress(), getDEFVALBAddress(), compare);
+                writeShadowed16(ShadowedRegister::INTCON, getIntConAAddress(), getIntConBAddress(), control);
+                writeShadowed16(ShadowedRegister::GPINTEN, getGPINTENAAddress(), getGPINTENBAddress(), enable);
+            }
+        }
+        uint16_t readOutputLatch() noexcept { return readShadowed16(ShadowedRegister::OLAT, getOLATAAddress(), getOLATBAddress()); }
+        void writeOutputLatch(uint16_t pattern) noexcept { return writeShadowed16(ShadowedRegister::OLAT, getOLATAAddress(), getOLATBAddress(), pattern); }
+        /**
+         * Reload the register shadow (and the cached IOCON state) from the
+         * chip. Only needed if the chip was modified behind the back of this
+         * object.
+         */
+        void resync() noexcept {
+            refreshIOCon();
+            if constexpr (ShadowRegisters) {
+                _shadow.set(ShadowedRegister::IODIR, read16(getIODIRAAddress(), getIODIRBAddress()));
+                _shadow.set(ShadowedRegister::IPOL, read16(getIOPOLAAddress(), getIOPOLBAddress()));
+                _shadow.set(ShadowedRegister::GPINTEN, read16(getGPINTENAAddress(), getGPINTENBAddress()));
+                _shadow.set(ShadowedRegister::DEFVAL, read16(getDEFVALAAddress(), getDEFVALBAddress()));
+                _shadow.set(ShadowedRegister::INTCON, read16(getIntConAAddress(), getIntConBAddress()));
+                _shadow.set(ShadowedRegister::GPPU, read16(getGPPUAAddress(), getGPPUBAddress()));
+                _shadow.set(ShadowedRegister::OLAT, read16(getOLATAAddress(), getOLATBAddress()));
+            }
+        }
+
+        void enableHardwareAddressPins() noexcept {
+            if (!hardwareAddressEnabled()) {
+                setIOCon(getIOCon() | 0b0000'1000);
+            }
+        }
+        void disableHardwareAddressPins() noexcept {
+            if (hardwareAddressEnabled()) {
+                setIOCon(getIOCon() & 0b1111'0110);
+            }
+        }
+        void interruptPinsAreMirrored() noexcept {
+            setIOCon(getIOCon() | 0b0100'0000);
+        }
+        void interruptPinsAreIndependent() noexcept {
+            setIOCon(getIOCon() & 0b1011'1110);
+        }
+        void enableSequentialOperation() noexcept {
+            if (!sequentialOperationEnabled()) {
+                setIOCon(getIOCon() & 0b1101'1110);
+            }
+        }
+        void disableSequentialOperation() noexcept {
+            if (sequentialOperationEnabled()) {
+                setIOCon(getIOCon() | 0b0010'0000);
+            }
+        }
+        static constexpr uint16_t BitMasks[] = {
+            1,
+            1 << 1,
+            1 << 2,
+            1 << 3,
+            1 << 4,
+            1 << 5,
+            1 << 6,
+            1 << 7,
+            1 << 8,
+            1 << 9,
+            1 << 10,
+            1 << 11,
+            1 << 12,
+            1 << 13,
+            1 << 14,
+            1 << 15,
+        };
+        /**
+         * Set the output latch bit of the given pin. The new value is built
+         * from the output latch (not the sampled GPIO state) and only the
+         * port holding the pin is written.
+         */
+        void digitalWrite(uint8_t pin, uint8_t value) noexcept {
+            if (pin > 15) {
+                return;
+            }
+            if (auto pinMask = BitMasks[pin]; value == LOW) {
+                clearPins(pinMask);
+            } else {
+                setPins(pinMask);
+            }
+        }
+        /**
+         * Drive every pin in mask high. With a register shadow this is a
+         * single write transaction, otherwise the output latch is read first.
+         */
+        void setPins(uint16_t mask) noexcept {
+            writeOutputLatchMasked(mask, readOutputLatch() | mask);
+        }
+        /**
+         * Drive every pin in mask low.
+         */
+        void clearPins(uint16_t mask) noexcept {
+            writeOutputLatchMasked(mask, readOutputLatch() & ~mask);
+        }
+        /**
+         * Invert the output latch of every pin in mask.
+         */
+        void togglePins(uint16_t mask) noexcept {
+            writeOutputLatchMasked(mask, readOutputLatch() ^ mask);
+        }
+        /**
+         * Replace the output latch bits selected by mask with the matching
+         * bits of value, leaving every other pin alone.
+         */
+        void updatePins(uint16_t mask, uint16_t value) noexcept {
+            writeOutputLatchMasked(mask, (readOutputLatch() & ~mask) | (value & mask));
+        }
+        int digitalRead(uint8_t pin) {
+            if (pin > 15) {
+                return -1;
+            }  else {
+                return (readGPIOs() & BitMasks[pin]) ? HIGH : LOW;
+            }
+        }
+        void pinMode(uint8_t pin, decltype(INPUT) kind) {
+            if (pin > 15) {
+                return;
+            }
+            auto maskedValue = BitMasks[pin];
+            auto dirmask = readGPIOsDirection();
+            if (kind == INPUT_PULLUP) {
+                auto pullups = readGPIOPullup();
+                writeShadowedMasked(ShadowedRegister::GPPU, getGPPUAAddress(), getGPPUBAddress(), maskedValue, pullups | maskedValue);
+                writeShadowedMasked(ShadowedRegister::IODIR, getIODIRAAddress(), getIODIRBAddress(), maskedValue, maskedValue | dirmask);
+            } else if (kind == INPUT) {
+                writeShadowedMasked(ShadowedRegister::IODIR, getIODIRAAddress(), getIODIRBAddress(), maskedValue, maskedValue | dirmask);
+            } else {
+                writeShadowedMasked(ShadowedRegister::IODIR, getIODIRAAddress(), getIODIRBAddress(), maskedValue, (~maskedValue) & dirmask);
+            }
+        }
+        void writePortA(uint8_t value) {
+            write(getGPIOAAddress(), value);
+            setShadowedHalf(ShadowedRegister::OLAT, MCP23x17Port::A, value);
+        }
+        void writePortB(uint8_t value) {
+            write(getGPIOBAddress(), value);
+            setShadowedHalf(ShadowedRegister::OLAT, MCP23x17Port::B, value);
+        }
+        uint8_t readPortA() noexcept { return read(getGPIOAAddress()); }
+        uint8_t readPortB() noexcept { return read(getGPIOBAddress()); }
+        uint8_t readPort(MCP23x17Port port) noexcept { return (port == MCP23x17Port::B) ? readPortB() : readPortA(); }
+        uint8_t readPortInterruptFlags(MCP23x17Port port) noexcept { return read((port == MCP23x17Port::B) ? getINTFBAddress() : getINTFAAddress()); }
+        /**
+         * Change the direction of the pins of a single port with one 8-bit
+         * write, the other port is left alone.
+         */
+        void writePortDirection(MCP23x17Port port, uint8_t direction) noexcept {
+            write((port == MCP23x17Port::B) ? getIODIRBAddress() : getIODIRAAddress(), direction);
+            setShadowedHalf(ShadowedRegister::IODIR, port, direction);
+        }
+        /**
+         * Clock a sequence of values out of the output latch of one port
+         * without re-addressing the chip between them. IOCON.SEQOP is
+         * disabled for the duration of the stream (a fixed configuration must
+         * already have it disabled) and everything happens in one bus
+         * transaction. With BANK = 1 the address pointer stays on the latch
+         * so every byte on the bus is a new port value; with BANK = 0 it
+         * toggles between the two halves, so the latch of the other port is
+         * rewritten with its current value between samples, halving the rate.
+         */
+        void streamToPort(const uint8_t* pattern, size_t length, MCP23x17Port port = MCP23x17Port::A) noexcept {
+            if (length == 0) {
+                return;
+            }
+            BatchHolder batch(*this);
+            auto last = pattern[length - 1];
+            auto isPortB = (port == MCP23x17Port::B);
+            auto latch = readOutputLatch();
+            auto previous = enterByteMode();
+            byte target = isPortB ? getOLATBAddress() : getOLATAAddress();
+            if (registersAreSequential()) {
+                byte other = static_cast<byte>(isPortB ? (latch & 0xFF) : (latch >> 8));
+                byte buffer[StreamChunkLength * 2];
+                while (length > 0) {
+                    byte count = (length < StreamChunkLength) ? length : StreamChunkLength;
+                    for (byte i = 0; i < count; ++i) {
+                        buffer[i * 2] = pattern[i];
+                        buffer[(i * 2) + 1] = other;
+                    }
+                    writeBurst(target, buffer, count * 2);
+                    pattern += count;
+                    length -= count;
+                }
+            } else {
+                while (length > 0) {
+                    byte count = (length < 0xFF) ? length : 0xFF;
+                    writeBurst(target, pattern, count);
+                    pattern += count;
+                    length -= count;
+                }
+            }
+            setShadowedHalf(ShadowedRegister::OLAT, port, last);
+            leaveByteMode(previous);
+        }
+        /**
+         * Write a sequence of output latch values alternating between the
+         * ports: pairs holds A0, B0, A1, B1 and so on and every value becomes
+         * visible on the pins in that order. Sequential operation is handled
+         * like streamToPort. With BANK = 0 the address pointer toggling
+         * between the halves does all of the work so the whole sequence is
+         * one stream; with BANK = 1 every value is a separate write.
+         */
+        void streamToPorts(const uint8_t* pairs, size_t pairCount) noexcept {
+            if (pairCount == 0) {
+                return;
+            }
+            BatchHolder batch(*this);
+            auto lastA = pairs[(pairCount * 2) - 2];
+            auto lastB = pairs[(pairCount * 2) - 1];
+            auto previous = enterByteMode();
+            if (registersAreSequential()) {
+                while (pairCount > 0) {
+                    byte count = (pairCount < 0x7F) ? pairCount : 0x7F;
+                    writeBurst(getOLATAAddress(), pairs, count * 2);
+                    pairs += count * 2;
+                    pairCount -= count;
+                }
+            } else {
+                for (size_t i = 0; i < pairCount; ++i) {
+                    write(getOLATAAddress(), pairs[i * 2]);
+                    write(getOLATBAddress(), pairs[(i * 2) + 1]);
+                }
+            }
+            setShadowedHalf(ShadowedRegister::OLAT, MCP23x17Port::A, lastA);
+            setShadowedHalf(ShadowedRegister::OLAT, MCP23x17Port::B, lastB);
+            leaveByteMode(previous);
+        }
+        /**
+         * Sample the GPIO register of one port length times as fast as the
+         * bus allows, see streamToPort for how the address pointer is held.
+         * With BANK = 0 every other byte read belongs to the other port and
+         * is dropped.
+         */
+        void streamFromPort(uint8_t* out, size_t length, MCP23x17Port port = MCP23x17Port::A) noexcept {
+            if (length == 0) {
+                return;
+            }
+            BatchHolder batch(*this);
+            auto previous = enterByteMode();
+            byte target = (port == MCP23x17Port::B) ? getGPIOBAddress() : getGPIOAAddress();
+            if (registersAreSequential()) {
+                byte buffer[StreamChunkLength * 2];
+                while (length > 0) {
+                    byte count = (length < StreamChunkLength) ? length : StreamChunkLength;
+                    readBurst(target, buffer, count * 2);
+                    for (byte i = 0; i < count; ++i) {
+                        out[i] = buffer[i * 2];
+                    }
+                    out += count;
+                    length -= count;
+                }
+            } else {
+                while (length > 0) {
+                    byte count = (length < 0xFF) ? length : 0xFF;
+                    readBurst(target, out, count);
+                    out += count;
+                    length -= count;
+                }
+            }
+            leaveByteMode(previous);
+        }
+        /**
+         * Read every register of the chip. With SEQOP enabled this is one
+         * burst in BANK = 0 mode and one burst per port in BANK = 1 mode.
+         * Reading INTCAP and GPIO clears a pending interrupt.
+         */
+        Snapshot snapshot() noexcept {
+            Snapshot result { };
+            BatchHolder batch(*this);
+            if (sequentialOperationEnabled()) {
+                if (registersAreSequential()) {
+                    readBurst(0x00, result.registers, Snapshot::RegisterCount);
+                } else {
+                    byte ports[2][Snapshot::RegisterCount / 2];
+                    readBurst(0x00, ports[0], Snapshot::RegisterCount / 2);
+                    readBurst(0x10, ports[1], Snapshot::RegisterCount / 2);
+                    for (byte i = 0; i < Snapshot::RegisterCount / 2; ++i) {
+                        result.registers[i * 2] = ports[0][i];
+                        result.registers[(i * 2) + 1] = ports[1][i];
+                    }
+                }
+            } else {
+                for (byte i = 0; i < Snapshot::RegisterCount; i += 2) {
+                    auto value = read16(canonicalAddress(i), canonicalAddress(i + 1));
+                    result.registers[i] = static_cast<byte>(value & 0xFF);
+                    result.registers[i + 1] = static_cast<byte>(value >> 8);
+                }
+            }
+            return result;
+        }
+        /**
+         * Write a snapshot back to the chip in as few bursts as the current
+         * bank mode allows (one in BANK = 0 with SEQOP enabled). The output
+         * latch is restored, INTF and INTCAP are read only and are skipped.
+         * The bank and sequential operation settings of the snapshot are only
+         * applied at the very end so that they cannot move the address
+         * pointer in the middle of the burst; a fixed configuration keeps its
+         * own IOCON value.
+         */
+        void restore(const Snapshot& snap) noexcept {
+            constexpr byte IOConIndex = 0x0A;
+            constexpr byte INTFIndex = 0x0E;
+            constexpr byte INTCAPIndex = 0x10;
+            constexpr byte GPIOIndex = 0x12;
+            constexpr byte OLATIndex = 0x14;
+            auto target = static_cast<byte>(snap.registers[IOConIndex] & 0b1111'1110);
+            auto inPlace = ioconForCurrentMode(target);
+            byte values[Snapshot::RegisterCount];
+            for (byte i = 0; i < Snapshot::RegisterCount; ++i) {
+                values[i] = snap.registers[i];
+            }
+            values[IOConIndex] = inPlace;
+            values[IOConIndex + 1] = inPlace;
+            // writing GPIO writes OLAT so make sure both agree
+            values[GPIOIndex] = snap.registers[OLATIndex];
+            values[GPIOIndex + 1] = snap.registers[OLATIndex + 1];
+            {
+                BatchHolder batch(*this);
+                if (sequentialOperationEnabled()) {
+                    if (registersAreSequential()) {
+                        writeBurst(0x00, values, Snapshot::RegisterCount);
+                    } else {
+                        byte ports[2][Snapshot::RegisterCount / 2];
+                        for (byte i = 0; i < Snapshot::RegisterCount / 2; ++i) {
+                            ports[0][i] = values[i * 2];
+                            ports[1][i] = values[(i * 2) + 1];
+                        }
+                        writeBurst(0x00, ports[0], Snapshot::RegisterCount / 2);
+                        writeBurst(0x10, ports[1], Snapshot::RegisterCount / 2);
+                    }
+                } else {
+                    for (byte i = 0; i < Snapshot::RegisterCount; i += 2) {
+                        if (i == INTFIndex || i == INTCAPIndex || i == GPIOIndex) {
+                            continue;
+                        } else if (i == IOConIndex) {
+                            write(getIOConAddress(), inPlace);
+                            if constexpr (!HasStaticConfiguration) {
+                                // HAEN may have changed, the next frame must use the new address
+                                closeOpenWrite();
+                                updateIOConFlags(inPlace);
+                            }
+                        } else {
+                            write16(canonicalAddress(i), canonicalAddress(i + 1), static_cast<uint16_t>(values[i]) | (static_cast<uint16_t>(values[i + 1]) << 8));
+                        }
+                    }
+                }
+                closeOpenWrite();
+                if constexpr (!HasStaticConfiguration) {
+                    // the IOCON slot of the burst may have switched HAEN, so
+                    // the flags must follow before IOCON is addressed again
+                    updateIOConFlags(inPlace);
+                    if (target != inPlace) {
+                        setIOCon(target);
+                    }
+                }
+            }
+            if constexpr (ShadowRegisters) {
+                auto pair = [&values](byte index) noexcept { return static_cast<uint16_t>(values[index]) | (static_cast<uint16_t>(values[index + 1]) << 8); };
+                _shadow.set(ShadowedRegister::IODIR, pair(0x00));
+                _shadow.set(ShadowedRegister::IPOL, pair(0x02));
+                _shadow.set(ShadowedRegister::GPINTEN, pair(0x04));
+                _shadow.set(ShadowedRegister::DEFVAL, pair(0x06));
+                _shadow.set(ShadowedRegister::INTCON, pair(0x08));
+                _shadow.set(ShadowedRegister::GPPU, pair(0x0C));
+                _shadow.set(ShadowedRegister::OLAT, pair(OLATIndex));
+            }
+        }
+    private:
+        /**
+         * Address of a register given its position in the BANK = 0 layout
+         */
+        constexpr byte canonicalAddress(byte index) const noexcept {
+            return registersAreSequential() ? index : static_cast<byte>((index >> 1) | ((index & 1) ? 0x10 : 0x00));
+        }
+        /**
+         * The given IOCON value with BANK and SEQOP replaced by the current
+         * settings, safe to write in the middle of a burst.
+         */
+        constexpr byte ioconForCurrentMode(byte value) const noexcept {
+            if constexpr (HasStaticConfiguration) {
+                return Configuration::Value;
+            } else {
+                return static_cast<byte>((value & 0b0101'1110) |
+                                         (registersAreSequential() ? 0 : 0b1000'0000) |
+                                         (sequentialOperationEnabled() ? 0 : 0b0010'0000));
+            }
+        }
+        /// samples per burst when the other port has to be interleaved
+        static constexpr byte StreamChunkLength = 16;
+        /// IOCON bit 0 is unimplemented so it never reads back as this
+        static constexpr byte IOConUnchanged = 0xFF;
+        /**
+         * Disable sequential operation so the address pointer holds still.
+         * @return the IOCON value leaveByteMode has to restore
+         */
+        byte enterByteMode() noexcept {
+            if constexpr (HasStaticConfiguration) {
+                static_assert(!Configuration::SequentialOperation, "Streaming requires a configuration with sequential operation disabled");
+                return IOConUnchanged;
+            } else {
+                if (!sequentialOperationEnabled()) {
+                    return IOConUnchanged;
+                }
+                auto previous = getIOCon();
+                setIOCon(previous | 0b0010'0000);
+                return previous;
+            }
+        }
+        void leaveByteMode(byte previous) noexcept {
+            if constexpr (!HasStaticConfiguration) {
+                if (previous != IOConUnchanged) {
+                    setIOCon(previous);
+                }
+            }
+        }
+        void setShadowedHalf(ShadowedRegister which, MCP23x17Port port, byte value) noexcept {
+            if constexpr (ShadowRegisters) {
+                auto current = _shadow.get(which);
+                if (port == MCP23x17Port::B) {
+                    current = (current & 0x00FF) | (static_cast<uint16_t>(value) << 8);
+                } else {
+                    current = (current & 0xFF00) | value;
+                }
+                _shadow.set(which, current);
+            }
+        }
+    protected:
+        /**
+         * Finish the write frame a batch left open, for derived classes which
+         * change where the next frame goes (its opcode for example).
+         */
+        void finishOpenWrite() noexcept {
+            closeOpenWrite();
+        }
+        /**
+         * The IOCON bits this driver keeps track of (BANK, SEQOP, HAEN and
+         * INTPOL) as currently assumed, everything else reads as zero.
+         */
+        byte getTrackedIOCon() const noexcept {
+            return (_registersAreSequential ? 0 : 0b1000'0000) |
+                   (_sequentialOperationEnabled ? 0 : 0b0010'0000) |
+                   (_hardwareAddressPinsEnabled ? 0b0000'1000 : 0) |
+                   (_polarityIsActiveLow ? 0 : 0b0000'0010);
+        }
+        /**
+         * Replace the tracked IOCON bits without talking to the chip, for
+         * derived classes which drive several chips through one object.
+         */
+        void setTrackedIOCon(byte value) noexcept {
+            updateIOConFlags(value);
+        }
+        /**
+         * Write pattern to DEFVAL and read it straight back from the chip,
+         * leaving the register shadow alone. Used to check that the bus is
+         * working, the caller has to restore DEFVAL afterwards.
+         */
+        bool scratchRoundTrip(uint16_t pattern) noexcept {
+            write16(getDEFVALAAddress(), getDEFVALBAddress(), pattern);
+            return read16(getDEFVALAAddress(), getDEFVALBAddress()) == pattern;
+        }
+    private:
+        void updateIOConFlags(byte value) noexcept {
+            _registersAreSequential = ((value & 0b1000'0000) == 0);
+            _polarityIsActiveLow = ((value & 0b0000'0010) == 0);
+            _hardwareAddressPinsEnabled = ((value & 0b0000'1000) != 0);
+            _sequentialOperationEnabled = ((value & 0b0010'0000) == 0);
+        }
+    private:
+        MCP23x17RegisterShadow<ShadowRegisters> _shadow;
+        bool _registersAreSequential = true;
+        bool _polarityIsActiveLow = true;
+        bool _hardwareAddressPinsEnabled = false;
+        bool _sequentialOperationEnabled = true;
+        bool _usingPowerOnAddress = false;
+        byte _batchDepth = 0;
+        byte _openWriteAddress = NoOpenWrite;
+        byte _openWriteLength = 0;
+};
+
+} // end namespace bonuspin
+
+template<typename Derived, byte address, int resetPin, bool shadowRegisters, typename IOConfiguration>
+void digitalWrite(uint8_t pin, uint8_t value, bonuspin::MCP23x17Core<Derived, address, resetPin, shadowRegisters, IOConfiguration>& mcp) noexcept {
+    mcp.digitalWrite(pin, value);
+}
+
+template<typename Derived, byte address, int resetPin, bool shadowRegisters, typename IOConfiguration>
+auto digitalRead(uint8_t pin, bonuspin::MCP23x17Core<Derived, address, resetPin, shadowRegisters, IOConfiguration>& mcp) noexcept {
+    return mcp.digitalRead(pin);
+}
+
+template<typename Derived, byte address, int resetPin, bool shadowRegisters, typename IOConfiguration>
+void pinMode(uint8_t pin, decltype(INPUT) kind, bonuspin::MCP23x17Core<Derived, address, resetPin, shadowRegisters, IOConfiguration>& mcp) noexcept {
+    mcp.pinMode(pin, kind);
+}
+
+
+#endif // end LIB_ICS_MCP23X17_H__
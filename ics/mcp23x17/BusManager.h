@@ -0,0 +1,223 @@
+/**
+ * @file
+ * Manage several hardware addressed MCP23S17 chips sharing a chip select
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23X17_BUSMANAGER_H__
+#define LIB_ICS_MCP23X17_BUSMANAGER_H__
+#include "Arduino.h"
+#include "../../core/fastpin.h"
+#include "../../core/spitransport.h"
+#include "../MCP23S17.h"
+namespace bonuspin
+{
+/**
+ * The MCP23S17 driver behind MCP23S17Bus: one object talks to every chip on
+ * the shared chip select and select() picks which one the following
+ * operations go to. Until hardware addressing has been enabled every frame
+ * goes to address 000, which all of the chips accept.
+ *
+ * The IOCON bits the driver depends on (BANK, SEQOP, HAEN and INTPOL) are
+ * kept per chip and swapped in by select(), so reconfiguring IOCON of one
+ * chip leaves the others alone. Disabling hardware addressing on a chip
+ * makes it answer to every frame sent to address 000, which is almost
+ * certainly not what you want.
+ * @tparam chipEnable the shared chip select pin
+ * @tparam Transport the SPI bus the chips are on
+ * @tparam spiClock the SPI clock in Hz until setSPIClock is called
+ */
+template<int chipEnable, typename Transport = HardwareSPITransport, uint32_t spiClock = 10000000>
+class MCP23S17BusDevice final : public MCP23x17SPIDevice<MCP23S17BusDevice<chipEnable, Transport, spiClock>, 0, -1, false, MCP23x17RuntimeConfiguration, Transport, spiClock> {
+    public:
+        using Parent = MCP23x17SPIDevice<MCP23S17BusDevice<chipEnable, Transport, spiClock>, 0, -1, false, MCP23x17RuntimeConfiguration, Transport, spiClock>;
+        using Self = MCP23S17BusDevice<chipEnable, Transport, spiClock>;
+        static_assert(chipEnable >= 0, "Must bind the chip enable to a real pin!");
+        static constexpr auto ChipEnablePin = chipEnable;
+        MCP23S17BusDevice() = default;
+        ~MCP23S17BusDevice() = default;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        MCP23S17BusDevice(const Self&) = delete;
+        MCP23S17BusDevice(Self&&) = delete;
+        constexpr auto getChipEnablePin() const noexcept { return ChipEnablePin; }
+        constexpr byte getSPIAddress() const noexcept { return this->hardwareAddressEnabled() ? _selected : 0b000; }
+        byte getSelected() const noexcept { return _selected; }
+        /**
+         * Direct the following operations at the chip with the given
+         * hardware address; a write frame left open by a batch is finished
+         * first since it belongs to the previous chip.
+         */
+        void select(byte device) noexcept {
+            device &= 0b111;
+            if (device != _selected) {
+                this->finishOpenWrite();
+                _iocon[_selected] = this->getTrackedIOCon();
+                _selected = device;
+                this->setTrackedIOCon(_iocon[_selected]);
+            }
+        }
+        /**
+         * Write IOCON of every chip at once through address 000, only
+         * works while hardware addressing is still disabled on all of them
+         * (after a reset).
+         */
+        void broadcastIOCon(byte value) noexcept {
+            select(0);
+            this->setIOCon(value);
+            for (auto& iocon : _iocon) {
+                iocon = value;
+            }
+        }
+        void enableCS() noexcept {
+            FastPin<ChipEnablePin>::clear();
+        }
+        void disableCS() noexcept {
+            FastPin<ChipEnablePin>::set();
+        }
+    private:
+        byte _selected = 0;
+        /// the tracked IOCON bits of every chip, the selected one is live in the core
+        byte _iocon[8] = { 0 };
+};
+
+/**
+ * Owns up to eight MCP23S17 chips which share a single chip select line and
+ * are told apart by their A2:A0 hardware address pins. begin() enables
+ * hardware addressing on every chip at once (while it is still disabled they
+ * all accept the same opcode) and leaves them in BANK = 0 with sequential
+ * operation enabled so every 16-bit register is a single burst.
+ *
+ * Without a reset pin begin() cannot know what state the chips are in, so
+ * it assumes they are still in BANK = 0 (IOCON at 0x0A) as they are after a
+ * power on reset; wire up the reset pin if the sketch can restart while the
+ * chips keep their configuration.
+ *
+ * The chips are driven through a single MCP23S17BusDevice, so the SPI
+ * framing, transport and clock are the same as for a MCP23S17. Every bulk
+ * operation is performed under one SPI transaction with a single chip
+ * select frame per device, which is the minimum the protocol allows.
+ * device() gives access to the full driver for one of the chips.
+ * @tparam chipEnable the shared chip select pin
+ * @tparam deviceCount the number of chips, addressed 0 to deviceCount - 1
+ * @tparam resetPin the pin connected to every RESET line, negative if none
+ * @tparam Transport the SPI bus the chips are on, the hardware SPI
+ * peripheral by default
+ * @tparam spiClock the SPI clock in Hz until setSPIClock is called
+ */
+template<int chipEnable, byte deviceCount = 8, int resetPin = -1, typename Transport = HardwareSPITransport, uint32_t spiClock = 10000000>
+class MCP23S17Bus final {
+    public:
+        static_assert(deviceCount > 0 && deviceCount <= 8, "Between one and eight devices can share a chip select");
+        using Self = MCP23S17Bus<chipEnable, deviceCount, resetPin, Transport, spiClock>;
+        using Device = MCP23S17BusDevice<chipEnable, Transport, spiClock>;
+        static constexpr auto ChipEnablePin = chipEnable;
+        static constexpr auto DeviceCount = deviceCount;
+        static constexpr auto ResetPin = resetPin;
+        static constexpr auto HasResetPin = (ResetPin >= 0);
+    private:
+        // HAEN set, everything else at the power on defaults
+        static constexpr byte BusIOCon = 0b0000'1000;
+    public:
+        MCP23S17Bus() = default;
+        MCP23S17Bus(const Self&) = delete;
+        MCP23S17Bus(Self&&) = delete;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        constexpr auto getChipEnablePin() const noexcept { return ChipEnablePin; }
+        constexpr auto getDeviceCount() const noexcept { return DeviceCount; }
+        const SPISettings& getSPISettings() const noexcept { return _device.getSPISettings(); }
+        uint32_t getSPIClock() const noexcept { return _device.getSPIClock(); }
+        void setSPIClock(uint32_t clock) noexcept { _device.setSPIClock(clock); }
+        void begin() noexcept {
+            ::pinMode(ChipEnablePin, OUTPUT);
+            ::digitalWrite(ChipEnablePin, HIGH);
+            Transport::begin();
+            if constexpr (HasResetPin) {
+                ::pinMode(ResetPin, OUTPUT);
+                {
+                    HoldPinLow<resetPin> holder;
+                    delayMicroseconds(2);
+                }
+            }
+            // with HAEN clear every chip ignores the address bits, so this
+            // one write to address 000 configures all of them
+            _device.broadcastIOCon(BusIOCon);
+        }
+        /**
+         * The driver pointed at the given chip, valid until another chip is
+         * selected. IOCON changes made through it only apply to that chip;
+         * the bulk operations of the bus do not care about BANK or SEQOP
+         * but every chip must keep hardware addressing enabled.
+         */
+        Device& device(byte index) noexcept {
+            _device.select(index);
+            return _device;
+        }
+        uint16_t readGPIOs(byte index) noexcept { return device(index).readGPIOs(); }
+        void writeOutputLatch(byte index, uint16_t value) noexcept { device(index).writeOutputLatch(value); }
+        void writeGPIOsDirection(byte index, uint16_t value) noexcept { device(index).writeGPIOsDirection(value); }
+        void writeGPIOPullup(byte index, uint16_t value) noexcept { device(index).writeGPIOPullup(value); }
+        void writeGPIOPolarity(byte index, uint16_t value) noexcept { device(index).writeGPIOPolarity(value); }
+        void writeGPIOInterruptEnable(byte index, uint16_t value) noexcept { device(index).writeGPIOInterruptEnable(value); }
+        /**
+         * Run operation(device, index) for every chip in turn under a single
+         * SPI transaction.
+         */
+        template<typename Operation>
+        void forEachDevice(Operation operation) noexcept {
+            typename Device::BatchHolder batch(_device);
+            for (byte i = 0; i < DeviceCount; ++i) {
+                operation(device(i), i);
+            }
+        }
+        /**
+         * Read the GPIO registers of every device in a single pass.
+         * @param states receives one 16-bit port value per device
+         */
+        void scan(uint16_t (&states)[DeviceCount]) noexcept {
+            forEachDevice([&states](Device& chip, byte i) { states[i] = chip.readGPIOs(); });
+        }
+        /**
+         * Write a separate output latch value to every device in one pass.
+         */
+        void writeOutputLatches(const uint16_t (&values)[DeviceCount]) noexcept {
+            forEachDevice([&values](Device& chip, byte i) { chip.writeOutputLatch(values[i]); });
+        }
+        void broadcastOutputLatch(uint16_t value) noexcept {
+            forEachDevice([value](Device& chip, byte) { chip.writeOutputLatch(value); });
+        }
+        void broadcastGPIOsDirection(uint16_t value) noexcept {
+            forEachDevice([value](Device& chip, byte) { chip.writeGPIOsDirection(value); });
+        }
+        void broadcastGPIOPullup(uint16_t value) noexcept {
+            forEachDevice([value](Device& chip, byte) { chip.writeGPIOPullup(value); });
+        }
+        void broadcastGPIOPolarity(uint16_t value) noexcept {
+            forEachDevice([value](Device& chip, byte) { chip.writeGPIOPolarity(value); });
+        }
+        void broadcastGPIOInterruptEnable(uint16_t value) noexcept {
+            forEachDevice([value](Device& chip, byte) { chip.writeGPIOInterruptEnable(value); });
+        }
+    private:
+        Device _device;
+};
+
+} // end namespace bonuspin
+#endif // end LIB_ICS_MCP23X17_BUSMANAGER_H__
@@ -0,0 +1,127 @@
+/**
+ * @file
+ * Poll a MCP23x17 for input changes through its interrupt flags when the
+ * INT lines are not connected
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23X17_CHANGEPOLLER_H__
+#define LIB_ICS_MCP23X17_CHANGEPOLLER_H__
+#include "Arduino.h"
+#include "../MCP23x17.h"
+namespace bonuspin
+{
+/**
+ * Keeps a cached copy of a set of input pins up to date by polling INTF
+ * instead of GPIO. Interrupt-on-change is enabled for the watched pins so
+ * the chip latches every change (even one which has already reverted) until
+ * the port is read. Each poll reads the flags of the watched ports and only
+ * reads GPIO for a port which has a flag set, which also clears its flags.
+ *
+ * When the pins of only one port are watched a quiet poll is a single byte
+ * instead of the two a full GPIO read costs; with both ports watched a
+ * quiet poll costs the same as readGPIOs and a change costs one extra read.
+ * @tparam Device the expander type
+ */
+template<typename Device>
+class MCP23x17ChangePoller final {
+    public:
+        using Self = MCP23x17ChangePoller<Device>;
+    public:
+        explicit MCP23x17ChangePoller(Device& device) noexcept : _device(device) { }
+        MCP23x17ChangePoller(const Self&) = delete;
+        MCP23x17ChangePoller(Self&&) = delete;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        /**
+         * Enable interrupt-on-change (against the previous value) for the
+         * given pins and load their current state. This replaces GPINTEN and
+         * the INTCON bits of the watched pins.
+         */
+        void begin(uint16_t watched) noexcept {
+            _watched = watched;
+            {
+                typename Device::BatchHolder batch(_device);
+                _device.writeInterruptOnChangeControlRegister(_device.readInterruptOnChangeControlRegister() & ~watched);
+                _device.writeGPIOInterruptEnable(watched);
+                // reading the ports clears anything which was pending
+                _state = _device.readGPIOs() & _watched;
+            }
+            _pollCount = 0;
+            _frameCount = 0;
+            _portReadsAvoided = 0;
+        }
+        /**
+         * Check the chip for changes on the watched pins.
+         * @return the watched pins whose level changed since the last poll
+         */
+        uint16_t poll() noexcept {
+            ++_pollCount;
+            uint16_t flags = 0;
+            if (watchesPortA() && watchesPortB()) {
+                flags = _device.readGPIOInterruptFlags();
+            } else if (watchesPortA()) {
+                flags = _device.readPortInterruptFlags(MCP23x17Port::A);
+            } else if (watchesPortB()) {
+                flags = static_cast<uint16_t>(_device.readPortInterruptFlags(MCP23x17Port::B)) << 8;
+            } else {
+                return 0;
+            }
+            ++_frameCount;
+            bool readA = (flags & 0x00FF) != 0;
+            bool readB = (flags & 0xFF00) != 0;
+            uint16_t current = _state;
+            if (readA && readB) {
+                current = _device.readGPIOs();
+                ++_frameCount;
+            } else if (readA) {
+                current = (current & 0xFF00) | _device.readPort(MCP23x17Port::A);
+                ++_frameCount;
+            } else if (readB) {
+                current = (current & 0x00FF) | (static_cast<uint16_t>(_device.readPort(MCP23x17Port::B)) << 8);
+                ++_frameCount;
+            }
+            _portReadsAvoided += (watchesPortA() && !readA) + (watchesPortB() && !readB);
+            current &= _watched;
+            auto changed = current ^ _state;
+            _state = current;
+            return changed;
+        }
+        /// the watched pins as of the last poll
+        uint16_t getState() const noexcept { return _state; }
+        uint16_t getWatchedPins() const noexcept { return _watched; }
+        unsigned long getPollCount() const noexcept { return _pollCount; }
+        /// register reads issued by poll, flags included
+        unsigned long getFrameCount() const noexcept { return _frameCount; }
+        /// watched ports whose GPIO register did not have to be read
+        unsigned long getPortReadsAvoided() const noexcept { return _portReadsAvoided; }
+    private:
+        bool watchesPortA() const noexcept { return (_watched & 0x00FF) != 0; }
+        bool watchesPortB() const noexcept { return (_watched & 0xFF00) != 0; }
+    private:
+        Device& _device;
+        uint16_t _watched = 0;
+        uint16_t _state = 0;
+        unsigned long _pollCount = 0;
+        unsigned long _frameCount = 0;
+        unsigned long _portReadsAvoided = 0;
+};
+
+} // end namespace bonuspin
+#endif // end LIB_ICS_MCP23X17_CHANGEPOLLER_H__
@@ -0,0 +1,177 @@
+/**
+ * @file
+ * Interrupt driven input capture for the MCP23x17 family
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23X17_INTERRUPTCAPTURE_H__
+#define LIB_ICS_MCP23X17_INTERRUPTCAPTURE_H__
+#include "Arduino.h"
+#include "../../core/ringbuffer.h"
+#include "../MCP23x17.h"
+namespace bonuspin
+{
+/**
+ * A single interrupt-on-change event
+ */
+struct MCP23x17InterruptEvent final {
+    /// micros() at the time the interrupt line was asserted
+    unsigned long timestamp;
+    /// the pins which caused the interrupt (INTF)
+    uint16_t pins;
+    /// the state of the port when the interrupt happened (INTCAP)
+    uint16_t captured;
+};
+
+/**
+ * Binds the INT line of a MCP23x17 to a microcontroller interrupt and turns
+ * each interrupt into an event holding INTF and INTCAP, read in a single
+ * burst. Events are queued in a lock free ring buffer which the main loop
+ * drains with next(). Only one engine may be bound to a given interrupt pin.
+ * The device should either mirror its interrupt lines or only have
+ * interrupts enabled on the port whose INT line is connected. Devices on
+ * the I2C bus must be used in deferred mode.
+ * @tparam Device the expander type
+ * @tparam interruptPin the microcontroller pin the INT line is connected to
+ * @tparam capacity the number of events which can be queued
+ * @tparam deferred when true the interrupt handler only records the time
+ * and service() must be called from the main loop to talk to the expander;
+ * otherwise the registers are read inside of the interrupt handler.
+ */
+template<typename Device, int interruptPin, byte capacity = 16, bool deferred = false>
+class MCP23x17InterruptCapture final {
+    public:
+        using Event = MCP23x17InterruptEvent;
+        using Self = MCP23x17InterruptCapture<Device, interruptPin, capacity, deferred>;
+        static constexpr auto InterruptPin = interruptPin;
+        static constexpr auto Deferred = deferred;
+        static_assert(Deferred || Device::CanTransferInInterrupt, "This device can only be read from the main loop, use deferred mode");
+    public:
+        explicit MCP23x17InterruptCapture(Device& device) noexcept : _device(device) { }
+        MCP23x17InterruptCapture(const Self&) = delete;
+        MCP23x17InterruptCapture(Self&&) = delete;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        /**
+         * Attach the interrupt handler; the device must already be begun and
+         * have its interrupts configured.
+         */
+        void begin() noexcept {
+            _instance = this;
+            ::pinMode(interruptPin, INPUT);
+            if constexpr (!Deferred) {
+                // keep the handler from firing in the middle of another
+                // transaction with the device
+                _device.usingInterrupt(digitalPinToInterrupt(interruptPin));
+            }
+            // drop anything which was pending before we were listening
+            uint16_t flags = 0;
+            uint16_t captured = 0;
+            _device.readGPIOInterruptFlagsAndCapture(flags, captured);
+            attachInterrupt(digitalPinToInterrupt(interruptPin), handleInterrupt, _device.interruptPinsAreActiveLow() ? FALLING : RISING);
+            if constexpr (!Deferred) {
+                // a change between clearing the flags and attaching leaves
+                // INT asserted without an edge, and it stays that way until
+                // the capture is read. service() covers this in deferred
+                // mode. Interrupts are off so the queue keeps one producer.
+                noInterrupts();
+                if (lineAsserted()) {
+                    capture(micros());
+                }
+                interrupts();
+            }
+        }
+        void end() noexcept {
+            detachInterrupt(digitalPinToInterrupt(interruptPin));
+            _instance = nullptr;
+        }
+        /**
+         * Bottom half for deferred mode: read the expander if the interrupt
+         * fired (or the line is still asserted because an edge was missed).
+         * Does nothing when not deferred.
+         * @return true if an event was queued
+         */
+        bool service() noexcept {
+            if constexpr (Deferred) {
+                noInterrupts();
+                bool pending = _pending;
+                unsigned long timestamp = _pendingTimestamp;
+                _pending = false;
+                interrupts();
+                if (pending || lineAsserted()) {
+                    return capture(pending ? timestamp : micros());
+                }
+            }
+            return false;
+        }
+        /**
+         * Take the oldest event from the queue
+         * @return false if there are no events
+         */
+        bool next(Event& event) noexcept { return _events.pop(event); }
+        bool available() const noexcept { return !_events.empty(); }
+        /**
+         * The number of events which were lost because the queue was full
+         */
+        unsigned int getDroppedEventCount() const noexcept {
+            noInterrupts();
+            unsigned int dropped = _dropped;
+            interrupts();
+            return dropped;
+        }
+    private:
+        bool lineAsserted() const noexcept {
+            return ::digitalRead(interruptPin) == (_device.interruptPinsAreActiveLow() ? LOW : HIGH);
+        }
+        bool capture(unsigned long timestamp) noexcept {
+            Event event { timestamp, 0, 0 };
+            _device.readGPIOInterruptFlagsAndCapture(event.pins, event.captured);
+            if (event.pins == 0) {
+                return false;
+            }
+            if (!_events.push(event)) {
+                ++_dropped;
+                return false;
+            }
+            return true;
+        }
+        void onInterrupt() noexcept {
+            if constexpr (Deferred) {
+                _pendingTimestamp = micros();
+                _pending = true;
+            } else {
+                capture(micros());
+            }
+        }
+        static void handleInterrupt() {
+            if (_instance) {
+                _instance->onInterrupt();
+            }
+        }
+    private:
+        static inline Self* _instance = nullptr;
+        Device& _device;
+        SPSCRingBuffer<Event, capacity> _events;
+        volatile unsigned long _pendingTimestamp = 0;
+        volatile bool _pending = false;
+        volatile unsigned int _dropped = 0;
+};
+
+} // end namespace bonuspin
+#endif // end LIB_ICS_MCP23X17_INTERRUPTCAPTURE_H__
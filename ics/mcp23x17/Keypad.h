@@ -0,0 +1,169 @@
+/**
+ * @file
+ * Matrix keypad scanning through a MCP23x17
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23X17_KEYPAD_H__
+#define LIB_ICS_MCP23X17_KEYPAD_H__
+#include "Arduino.h"
+#include "../MCP23x17.h"
+namespace bonuspin
+{
+/**
+ * A key changing state between two scans
+ */
+struct MCP23x17KeyEvent final {
+    byte row;
+    byte column;
+    bool pressed;
+};
+
+/**
+ * Scans a key matrix with the rows on port A and the columns on port B.
+ * Port A latches zero, so a row is driven low by making it the only output
+ * on the port; every other row floats. The columns use the internal pullups
+ * and inverted polarity so a closed key reads as a one. A row therefore
+ * costs one 8-bit IODIRA write and one 8-bit GPIOB read, and the whole scan
+ * happens under a single bus transaction. Between the two the scan waits
+ * settleMicros so that a column the previous row pulled low has time to
+ * rise through the weak (~100k) internal pullup and the matrix capacitance;
+ * without it a fast bus can see the previous row's keys as phantom presses.
+ *
+ * A key matrix without diodes cannot tell three keys at the corners of a
+ * rectangle from four, so a scan where two rows share more than one closed
+ * column is reported as ghosted and dropped.
+ * @tparam Device the expander type, must not be shared with anything else
+ * @tparam rows the number of rows, starting at GPA0
+ * @tparam columns the number of columns, starting at GPB0
+ * @tparam settleMicros how long to wait after driving a row before reading
+ * the columns, in microseconds
+ */
+template<typename Device, byte rows = 8, byte columns = 8, unsigned int settleMicros = 5>
+class MCP23x17Keypad final {
+    public:
+        static_assert(rows > 0 && rows <= 8, "Between one and eight rows are supported");
+        static_assert(columns > 0 && columns <= 8, "Between one and eight columns are supported");
+        using Event = MCP23x17KeyEvent;
+        using Self = MCP23x17Keypad<Device, rows, columns, settleMicros>;
+        static constexpr auto Rows = rows;
+        static constexpr auto Columns = columns;
+        static constexpr auto SettleMicros = settleMicros;
+        static constexpr byte ColumnMask = static_cast<byte>((1u << columns) - 1);
+    public:
+        explicit MCP23x17Keypad(Device& device) noexcept : _device(device) { }
+        MCP23x17Keypad(const Self&) = delete;
+        MCP23x17Keypad(Self&&) = delete;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        /**
+         * Configure the expander, it must already be begun.
+         */
+        void begin() noexcept {
+            typename Device::BatchHolder batch(_device);
+            _device.writeGPIOsDirection(0xFFFF);
+            _device.writeOutputLatch(0x0000);
+            _device.writeGPIOPullup(static_cast<uint16_t>(ColumnMask) << 8);
+            _device.writeGPIOPolarity(static_cast<uint16_t>(ColumnMask) << 8);
+            for (byte i = 0; i < Rows; ++i) {
+                _keys[i] = 0;
+                _changed[i] = 0;
+            }
+        }
+        /**
+         * Read the whole matrix and record which keys changed since the
+         * previous scan. The last row stays driven afterwards, which is
+         * harmless since nothing else uses port A.
+         * @return true if at least one key changed
+         */
+        bool scan() noexcept {
+            byte current[Rows];
+            {
+                typename Device::BatchHolder batch(_device);
+                for (byte row = 0; row < Rows; ++row) {
+                    _device.writePortDirection(MCP23x17Port::A, static_cast<byte>(~(1 << row)));
+                    // the new direction takes effect as soon as its byte is
+                    // clocked in, even with the frame still open
+                    if constexpr (SettleMicros > 0) {
+                        delayMicroseconds(SettleMicros);
+                    }
+                    current[row] = _device.readPortB() & ColumnMask;
+                }
+            }
+            _ghosted = isGhosted(current);
+            if (_ghosted) {
+                return false;
+            }
+            bool changed = false;
+            for (byte row = 0; row < Rows; ++row) {
+                _changed[row] |= current[row] ^ _keys[row];
+                _keys[row] = current[row];
+                changed |= (_changed[row] != 0);
+            }
+            return changed;
+        }
+        /**
+         * Take the next unreported key change
+         * @return false if every change has been reported
+         */
+        bool next(Event& event) noexcept {
+            for (byte row = 0; row < Rows; ++row) {
+                if (auto pending = _changed[row]; pending != 0) {
+                    auto column = static_cast<byte>(__builtin_ctz(pending));
+                    _changed[row] &= static_cast<byte>(pending - 1);
+                    event.row = row;
+                    event.column = column;
+                    event.pressed = (_keys[row] >> column) & 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+        bool isPressed(byte row, byte column) const noexcept {
+            return (row < Rows) && (column < Columns) && ((_keys[row] >> column) & 1);
+        }
+        /**
+         * The closed columns of the given row as of the last clean scan
+         */
+        byte getRow(byte row) const noexcept { return row < Rows ? _keys[row] : 0; }
+        /**
+         * True if the last scan was dropped because of ghosting
+         */
+        bool ghosted() const noexcept { return _ghosted; }
+    private:
+        static bool isGhosted(const byte (&current)[Rows]) noexcept {
+            for (byte i = 0; i < Rows; ++i) {
+                for (byte j = i + 1; j < Rows; ++j) {
+                    // more than one shared column closes a rectangle
+                    if (byte shared = current[i] & current[j]; shared & (shared - 1)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+    private:
+        Device& _device;
+        byte _keys[Rows] = { 0 };
+        byte _changed[Rows] = { 0 };
+        bool _ghosted = false;
+};
+
+} // end namespace bonuspin
+#endif // end LIB_ICS_MCP23X17_KEYPAD_H__
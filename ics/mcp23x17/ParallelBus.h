@@ -0,0 +1,184 @@
+/**
+ * @file
+ * 8080 and 6800 style parallel bus driver for displays hanging off of a
+ * MCP23x17
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23X17_PARALLELBUS_H__
+#define LIB_ICS_MCP23X17_PARALLELBUS_H__
+#include "Arduino.h"
+#include "../MCP23x17.h"
+namespace bonuspin
+{
+/**
+ * The handshake used by a parallel bus peripheral
+ */
+enum class ParallelBusProtocol : byte {
+    /// separate active low WR and RD strobes, data latched as WR rises
+    Intel8080,
+    /// an active high E strobe plus a R/W direction line, data latched as E
+    /// falls
+    Motorola6800,
+};
+
+/**
+ * Drives an 8-bit parallel bus with the data lines on port A and the
+ * control lines on port B; the remaining port B pins keep the value they had
+ * when begin() was called. The expander is put into BANK = 0 with sequential
+ * operation disabled so that the address pointer toggles between OLATA and
+ * OLATB. A byte is then four bus bytes (data, strobe active, data, strobe
+ * released) and a bulk write of any length is one chip select.
+ * @tparam Device the expander type
+ * @tparam protocol the handshake of the peripheral
+ * @tparam rsBit the port B bit connected to RS (D/C), high selects data
+ * @tparam strobeBit the port B bit connected to WR (8080) or E (6800)
+ * @tparam readBit the port B bit connected to RD (8080) or R/W (6800)
+ */
+template<typename Device, ParallelBusProtocol protocol, byte rsBit, byte strobeBit, byte readBit>
+class MCP23x17ParallelBus final {
+    public:
+        static_assert(rsBit < 8 && strobeBit < 8 && readBit < 8, "Control lines must be on port B");
+        static_assert(rsBit != strobeBit && rsBit != readBit && strobeBit != readBit, "Control lines must be distinct");
+        using Self = MCP23x17ParallelBus<Device, protocol, rsBit, strobeBit, readBit>;
+        static constexpr auto Protocol = protocol;
+        static constexpr bool Is8080 = (protocol == ParallelBusProtocol::Intel8080);
+        static constexpr byte RSMask = static_cast<byte>(1 << rsBit);
+        static constexpr byte StrobeMask = static_cast<byte>(1 << strobeBit);
+        static constexpr byte ReadMask = static_cast<byte>(1 << readBit);
+        static constexpr byte ControlMask = RSMask | StrobeMask | ReadMask;
+    public:
+        explicit MCP23x17ParallelBus(Device& device) noexcept : _device(device) { }
+        MCP23x17ParallelBus(const Self&) = delete;
+        MCP23x17ParallelBus(Self&&) = delete;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        /**
+         * Configure the expander, it must already be begun.
+         */
+        void begin() noexcept {
+            if constexpr (Device::HasStaticConfiguration) {
+                static_assert(!Device::Configuration::Banked, "The parallel bus requires BANK = 0");
+                static_assert(!Device::Configuration::SequentialOperation, "The parallel bus requires sequential operation to be disabled");
+            } else {
+                _device.makeRegistersSequential();
+                _device.disableSequentialOperation();
+            }
+            typename Device::BatchHolder batch(_device);
+            _otherBits = static_cast<byte>(_device.readOutputLatch() >> 8) & static_cast<byte>(~ControlMask);
+            _portB = idle(true, false);
+            _device.writePortB(_portB);
+            _device.writePortDirection(MCP23x17Port::A, 0x00);
+            _device.writePortDirection(MCP23x17Port::B, static_cast<byte>((_device.readGPIOsDirection() >> 8) & ~ControlMask));
+        }
+        void writeCommand(uint8_t value) noexcept { write(false, &value, 1); }
+        void writeData(uint8_t value) noexcept { write(true, &value, 1); }
+        void writeCommands(const uint8_t* values, size_t length) noexcept { write(false, values, length); }
+        void writeData(const uint8_t* values, size_t length) noexcept { write(true, values, length); }
+        /**
+         * Put every byte on the bus with RS set to the given level, pipelined
+         * into as few bursts as the expander allows. When RS changes it is
+         * set up (together with the first byte) before the first strobe.
+         */
+        void write(bool rs, const uint8_t* values, size_t length) noexcept {
+            constexpr byte BytesPerBurst = 8;
+            if (length == 0) {
+                return;
+            }
+            auto active = writeActive(rs);
+            auto released = idle(rs, false);
+            // room for the RS setup pair in front of the first burst
+            byte pairs[(BytesPerBurst * 4) + 2];
+            byte setup = 0;
+            if (released != _portB) {
+                pairs[0] = values[0];
+                pairs[1] = released;
+                setup = 2;
+                _portB = released;
+            }
+            typename Device::BatchHolder batch(_device);
+            while (length > 0) {
+                byte count = (length < BytesPerBurst) ? length : BytesPerBurst;
+                for (byte i = 0; i < count; ++i) {
+                    auto value = values[i];
+                    pairs[setup + (i * 4) + 0] = value;
+                    pairs[setup + (i * 4) + 1] = active;
+                    pairs[setup + (i * 4) + 2] = value;
+                    pairs[setup + (i * 4) + 3] = released;
+                }
+                _device.streamToPorts(pairs, (setup / 2) + (count * 2));
+                setup = 0;
+                values += count;
+                length -= count;
+            }
+        }
+        uint8_t readStatus() noexcept { return read(false); }
+        uint8_t readData() noexcept { return read(true); }
+        /**
+         * Read a single byte from the peripheral, port A is turned around
+         * for the duration of the read. RS (and R/W) are set up before the
+         * strobe is asserted.
+         */
+        uint8_t read(bool rs) noexcept {
+            typename Device::BatchHolder batch(_device);
+            _device.writePortDirection(MCP23x17Port::A, 0xFF);
+            if (auto setup = idle(rs, true); setup != _portB) {
+                _device.writePortB(setup);
+            }
+            _device.writePortB(readActive(rs));
+            auto value = _device.readPortA();
+            _portB = idle(rs, false);
+            _device.writePortB(_portB);
+            _device.writePortDirection(MCP23x17Port::A, 0x00);
+            return value;
+        }
+    private:
+        /// port B with no strobe active
+        constexpr byte idle(bool rs, bool reading) const noexcept {
+            byte value = _otherBits | (rs ? RSMask : 0);
+            if constexpr (Is8080) {
+                value |= StrobeMask | ReadMask;
+            } else if (reading) {
+                value |= ReadMask;
+            }
+            return value;
+        }
+        constexpr byte writeActive(bool rs) const noexcept {
+            if constexpr (Is8080) {
+                return idle(rs, false) & static_cast<byte>(~StrobeMask);
+            } else {
+                return idle(rs, false) | StrobeMask;
+            }
+        }
+        constexpr byte readActive(bool rs) const noexcept {
+            if constexpr (Is8080) {
+                return idle(rs, true) & static_cast<byte>(~ReadMask);
+            } else {
+                return idle(rs, true) | StrobeMask;
+            }
+        }
+    private:
+        Device& _device;
+        byte _otherBits = 0;
+        /// the last value written to port B
+        byte _portB = 0;
+};
+
+} // end namespace bonuspin
+#endif // end LIB_ICS_MCP23X17_PARALLELBUS_H__
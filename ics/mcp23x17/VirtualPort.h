@@ -0,0 +1,190 @@
+/**
+ * @file
+ * Logical ports whose bits are scattered over pins of several MCP23x17s
+ * @copyright
+ * Copyright (c) 2019 Joshua Scoggins
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+#ifndef LIB_ICS_MCP23X17_VIRTUALPORT_H__
+#define LIB_ICS_MCP23X17_VIRTUALPORT_H__
+#include "Arduino.h"
+#include "../MCP23x17.h"
+namespace bonuspin
+{
+/**
+ * One bit of a VirtualPort: the given pin of a statically allocated device
+ * @tparam device the expander object
+ * @tparam pin the pin on the expander, 0-7 is port A and 8-15 port B
+ */
+template<auto& device, byte pin>
+struct VirtualPin final {
+    static_assert(pin < 16, "MCP23x17 pins are numbered 0 to 15");
+    static constexpr byte Pin = pin;
+    static constexpr uint16_t Mask = static_cast<uint16_t>(1u << pin);
+    static constexpr auto& getDevice() noexcept { return device; }
+    static constexpr const void* getDeviceAddress() noexcept { return &device; }
+    VirtualPin() = delete;
+    ~VirtualPin() = delete;
+    VirtualPin(const VirtualPin&) = delete;
+    VirtualPin(VirtualPin&&) = delete;
+    VirtualPin& operator=(const VirtualPin&) = delete;
+    VirtualPin& operator=(VirtualPin&&) = delete;
+};
+
+template<byte... indices>
+struct VirtualPortIndices final { };
+
+template<byte count, byte... indices>
+struct MakeVirtualPortIndices {
+    using Type = typename MakeVirtualPortIndices<count - 1, count - 1, indices...>::Type;
+};
+
+template<byte... indices>
+struct MakeVirtualPortIndices<0, indices...> {
+    using Type = VirtualPortIndices<indices...>;
+};
+
+/**
+ * A logical port of up to 32 bits, bit n being the nth VirtualPin given.
+ * The masks and bit positions are resolved at compile time, so write()
+ * boils down to a few shifts per bit and a single updatePins (one output
+ * latch write) per device involved; read() is one readGPIOs per device.
+ *
+ *     using Bus = VirtualPort<VirtualPin<left, 3>, VirtualPin<right, 0>, VirtualPin<left, 9>>;
+ *     Bus::write(0b101);
+ *
+ * @tparam Pins the VirtualPin of each bit, least significant first
+ */
+template<typename... Pins>
+class VirtualPort final {
+    public:
+        static constexpr byte Width = sizeof...(Pins);
+        static_assert(Width > 0 && Width <= 32, "A virtual port holds between 1 and 32 bits");
+        using Word = uint32_t;
+        using Indices = typename MakeVirtualPortIndices<Width>::Type;
+    public:
+        /**
+         * Drive every pin of the port to the matching bit of value.
+         */
+        static void write(Word value) noexcept {
+            static_assert(pinsAreUnique(), "A pin can only be mapped to one bit of a virtual port");
+            writeDevices(value, Indices{});
+        }
+        /**
+         * Sample every pin of the port.
+         */
+        static Word read() noexcept {
+            static_assert(pinsAreUnique(), "A pin can only be mapped to one bit of a virtual port");
+            return readDevices(Indices{});
+        }
+        VirtualPort() = delete;
+        ~VirtualPort() = delete;
+        VirtualPort(const VirtualPort&) = delete;
+        VirtualPort(VirtualPort&&) = delete;
+        VirtualPort& operator=(const VirtualPort&) = delete;
+        VirtualPort& operator=(VirtualPort&&) = delete;
+    private:
+        static constexpr const void* Devices[] = { Pins::getDeviceAddress()... };
+        static constexpr byte PinNumbers[] = { Pins::Pin... };
+        static constexpr bool sameDevice(byte a, byte b) noexcept { return Devices[a] == Devices[b]; }
+        /**
+         * True if bit index is the lowest one living on its device, which is
+         * the one that issues the transaction for all of them.
+         */
+        static constexpr bool ownsDevice(byte index) noexcept {
+            for (byte i = 0; i < index; ++i) {
+                if (sameDevice(i, index)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        static constexpr uint16_t maskOf(byte owner) noexcept {
+            uint16_t mask = 0;
+            for (byte i = 0; i < Width; ++i) {
+                if (sameDevice(owner, i)) {
+                    mask |= static_cast<uint16_t>(1u << PinNumbers[i]);
+                }
+            }
+            return mask;
+        }
+        static constexpr bool pinsAreUnique() noexcept {
+            for (byte i = 0; i < Width; ++i) {
+                for (byte j = i + 1; j < Width; ++j) {
+                    if (sameDevice(i, j) && PinNumbers[i] == PinNumbers[j]) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+        /// move logical bit index to its pin if it lives on the device of owner
+        template<byte owner, byte index>
+        static constexpr uint16_t scatter(Word value) noexcept {
+            if constexpr (sameDevice(owner, index)) {
+                constexpr byte pin = PinNumbers[index];
+                if constexpr (pin >= index) {
+                    return static_cast<uint16_t>((value << (pin - index)) & (1u << pin));
+                } else {
+                    return static_cast<uint16_t>((value >> (index - pin)) & (1u << pin));
+                }
+            } else {
+                return 0;
+            }
+        }
+        /// move the pin of logical bit index back to its position in the word
+        template<byte owner, byte index>
+        static constexpr Word gather(uint16_t state) noexcept {
+            if constexpr (sameDevice(owner, index)) {
+                constexpr byte pin = PinNumbers[index];
+                if constexpr (pin >= index) {
+                    return (static_cast<Word>(state) >> (pin - index)) & (static_cast<Word>(1) << index);
+                } else {
+                    return (static_cast<Word>(state) << (index - pin)) & (static_cast<Word>(1) << index);
+                }
+            } else {
+                return 0;
+            }
+        }
+        template<byte owner, typename Pin, byte... indices>
+        static void writeDevice(Word value, VirtualPortIndices<indices...>) noexcept {
+            if constexpr (ownsDevice(owner)) {
+                Pin::getDevice().updatePins(maskOf(owner), (scatter<owner, indices>(value) | ...));
+            }
+        }
+        template<byte... indices>
+        static void writeDevices(Word value, VirtualPortIndices<indices...> all) noexcept {
+            (writeDevice<indices, Pins>(value, all), ...);
+        }
+        template<byte owner, typename Pin, byte... indices>
+        static Word readDevice(VirtualPortIndices<indices...>) noexcept {
+            if constexpr (ownsDevice(owner)) {
+                auto state = static_cast<uint16_t>(Pin::getDevice().readGPIOs());
+                return (gather<owner, indices>(state) | ...);
+            } else {
+                return 0;
+            }
+        }
+        template<byte... indices>
+        static Word readDevices(VirtualPortIndices<indices...> all) noexcept {
+            return (readDevice<indices, Pins>(all) | ...);
+        }
+};
+
+} // end namespace bonuspin
+#endif // end LIB_ICS_MCP23X17_VIRTUALPORT_H__
@@ -24,23 +24,194 @@
 #define LIB_ICS_X74SERIES_H__
 #include "Arduino.h"
 #include "../core/concepts.h"
+#include "../core/fastpin.h"
+#include "../core/spitransport.h"
+#include <SPI.h>
 namespace bonuspin
 {
+/**
+ * Byte order policy for HC595::shiftOut: the most significant byte of a
+ * value is shifted out first, so it ends up in the chip furthest down the
+ * chain. For types which are not integers significance is taken from the
+ * in memory layout as if the object was one big integer.
+ */
+struct MostSignificantFirst final {
+    static constexpr bool StartsAtHighAddress = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+    MostSignificantFirst() = delete;
+    ~MostSignificantFirst() = delete;
+};
+/**
+ * Byte order policy for HC595::shiftOut: the least significant byte of a
+ * value is shifted out first.
+ */
+struct LeastSignificantFirst final {
+    static constexpr bool StartsAtHighAddress = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+    LeastSignificantFirst() = delete;
+    ~LeastSignificantFirst() = delete;
+};
+
+template<typename T>
+struct IsPointer final {
+    static constexpr bool Value = false;
+};
+
+template<typename T>
+struct IsPointer<T*> final {
+    static constexpr bool Value = true;
+};
+
+template<typename T>
+struct IsPointer<T* const> final {
+    static constexpr bool Value = true;
+};
+
+/**
+ * HC595 backend which clocks data out with the Arduino shiftOut function.
+ * A backend provides setupPins, begin, beginTransfer, endTransfer and
+ * transfer as static functions, transfer sending a single byte most
+ * significant bit first, and names the LatchHolder used for the ST_CP line.
+ * setupPins only configures pins since it runs from the HC595 constructor;
+ * anything which needs a peripheral goes into begin.
+ * @tparam SH_CP the pin connected to SH_CP of 74HC595
+ * @tparam DS the pin connected to DS of 74HC595
+ */
+template<int SH_CP, int DS>
+struct ArduinoShiftOutBackend final {
+    template<int latch>
+    using LatchHolder = HoldPinLow<latch>;
+    static void setupPins() noexcept {
+        pinMode(SH_CP, OUTPUT);
+        pinMode(DS, OUTPUT);
+    }
+    static void begin() noexcept { }
+    static void beginTransfer() noexcept { }
+    static void endTransfer() noexcept { }
+    static void transfer(byte value) noexcept {
+        ::shiftOut(DS, SH_CP, MSBFIRST, value);
+    }
+    ArduinoShiftOutBackend() = delete;
+    ~ArduinoShiftOutBackend() = delete;
+    ArduinoShiftOutBackend(const ArduinoShiftOutBackend&) = delete;
+    ArduinoShiftOutBackend(ArduinoShiftOutBackend&&) = delete;
+    ArduinoShiftOutBackend& operator=(const ArduinoShiftOutBackend&) = delete;
+    ArduinoShiftOutBackend& operator=(ArduinoShiftOutBackend&&) = delete;
+};
+
+/**
+ * HC595 backend for chips with SH_CP on SCK and DS on MOSI, every byte is a
+ * single hardware SPI transfer. The 74HC595 is happy to be clocked well
+ * beyond what the SPI peripheral of an AVR can do. The HC595 must be begun
+ * from setup() since the SPI object may not exist yet when a global HC595 is
+ * constructed.
+ * @tparam clock the SPI clock in Hz
+ */
+template<uint32_t clock = 8000000>
+struct SPIShiftOutBackend final {
+    template<int latch>
+    using LatchHolder = HoldFastPinLow<latch>;
+    static SPISettings& getSPISettings() noexcept {
+        static SPISettings theSettings(clock, MSBFIRST, SPI_MODE0);
+        return theSettings;
+    }
+    static void setupPins() noexcept { }
+    static void begin() noexcept {
+        SPI.begin();
+    }
+    static void beginTransfer() noexcept {
+        SPI.beginTransaction(getSPISettings());
+    }
+    static void endTransfer() noexcept {
+        SPI.endTransaction();
+    }
+    static void transfer(byte value) noexcept {
+        SPI.transfer(value);
+    }
+    SPIShiftOutBackend() = delete;
+    ~SPIShiftOutBackend() = delete;
+    SPIShiftOutBackend(const SPIShiftOutBackend&) = delete;
+    SPIShiftOutBackend(SPIShiftOutBackend&&) = delete;
+    SPIShiftOutBackend& operator=(const SPIShiftOutBackend&) = delete;
+    SPIShiftOutBackend& operator=(SPIShiftOutBackend&&) = delete;
+};
+
+/**
+ * HC595 backend for arbitrary pins which bit-bangs through FastPin: every
+ * byte is eight unrolled data/clock store pairs on the resolved port
+ * registers and the latch is driven the same way. On boards without a known
+ * pin mapping this degrades to digitalWrite, which is still cheaper than
+ * ::shiftOut.
+ * @tparam SH_CP the pin connected to SH_CP of 74HC595
+ * @tparam DS the pin connected to DS of 74HC595
+ */
+template<int SH_CP, int DS>
+struct FastShiftOutBackend final {
+    using Transport = SoftwareSPITransport<SH_CP, DS>;
+    template<int latch>
+    using LatchHolder = HoldFastPinLow<latch>;
+    static void setupPins() noexcept {
+        Transport::begin();
+    }
+    static void begin() noexcept { }
+    static void beginTransfer() noexcept { }
+    static void endTransfer() noexcept { }
+    static void transfer(byte value) noexcept {
+        Transport::transfer(value);
+    }
+    FastShiftOutBackend() = delete;
+    ~FastShiftOutBackend() = delete;
+    FastShiftOutBackend(const FastShiftOutBackend&) = delete;
+    FastShiftOutBackend(FastShiftOutBackend&&) = delete;
+    FastShiftOutBackend& operator=(const FastShiftOutBackend&) = delete;
+    FastShiftOutBackend& operator=(FastShiftOutBackend&&) = delete;
+};
+
 /**
  * Makes working with HC595 chips easier
  * @tparam ST_CP the pin connected to ST_CP of 74HC595
  * @tparam SH_CP the pin connected to SH_CP of 74HC595
  * @tparam DS the pin connected to DS of 74HC595
+ * @tparam Backend how bytes are clocked into the chip, the Arduino shiftOut
+ * function by default
  * @todo add support for the OE line to be controlled if desired
  */
-template<int ST_CP, int SH_CP, int DS>
+template<int ST_CP, int SH_CP, int DS, typename Backend = ArduinoShiftOutBackend<SH_CP, DS>>
 class HC595 {
     public:
         static_assert(ST_CP != DS, "The latch and data pins are defined as the same pins!");
         static_assert(ST_CP != SH_CP, "The clock and latch pins are defined as the same pins!!");
         static_assert(SH_CP != DS, "The clock and data pins are defined as the same pins!");
-        using Self = HC595<ST_CP, SH_CP, DS>;
-        using LatchHolder = HoldPinLow<ST_CP>;
+        using Self = HC595<ST_CP, SH_CP, DS, Backend>;
+        using LatchHolder = typename Backend::template LatchHolder<ST_CP>;
+        using BackendType = Backend;
+        /**
+         * Keeps the backend ready for transfers for its lifetime
+         */
+        class TransferHolder final {
+            public:
+                TransferHolder() noexcept { Backend::beginTransfer(); }
+                ~TransferHolder() { Backend::endTransfer(); }
+                TransferHolder(const TransferHolder&) = delete;
+                TransferHolder(TransferHolder&&) = delete;
+                TransferHolder& operator=(const TransferHolder&) = delete;
+                TransferHolder& operator=(TransferHolder&&) = delete;
+        };
+        /**
+         * Holds the latch low with the backend ready; everything shifted out
+         * while it is alive appears on the outputs at once when it goes out
+         * of scope. Use it with shiftOutUnlatched to build up a transfer.
+         */
+        class Transaction final {
+            public:
+                Transaction() = default;
+                Transaction(const Transaction&) = delete;
+                Transaction(Transaction&&) = delete;
+                Transaction& operator=(const Transaction&) = delete;
+                Transaction& operator=(Transaction&&) = delete;
+            private:
+                // the latch is released before the backend is
+                TransferHolder _transfer;
+                LatchHolder _latch;
+        };
     public:
         /**
          * Setup the pins associated with this device
@@ -59,98 +230,275 @@ class HC595 {
          */
         void setupPins() {
             pinMode(ST_CP, OUTPUT);
-            pinMode(SH_CP, OUTPUT);
-            pinMode(DS, OUTPUT);
+            Backend::setupPins();
+        }
+        /**
+         * Bring up the backend, call this from setup() before shifting
+         * anything out; only the SPI backend actually needs it.
+         */
+        void begin() {
+            setupPins();
+            Backend::begin();
+        }
+        /**
+         * Shift out a byte without touching the latch, only useful inside of
+         * a Transaction.
+         */
+        void shiftOutUnlatched(byte value) noexcept {
+            Backend::transfer(value);
         }
         /**
          * Hold the latch low and shift out a single byte of data!
          */
         void shiftOut(byte value) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, value);
+            Transaction transaction;
+            Backend::transfer(value);
         }
         /**
          * Hold the latch low and shift out two bytes of data!
          */
         void shiftOut(uint16_t value) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, value >> 8);
-            ::shiftOut(DS, SH_CP, MSBFIRST, value);
+            Transaction transaction;
+            Backend::transfer(value >> 8);
+            Backend::transfer(value);
         }
         void shiftOut(uint8_t lower, uint8_t upper) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, upper);
-            ::shiftOut(DS, SH_CP, MSBFIRST, lower);
+            Transaction transaction;
+            Backend::transfer(upper);
+            Backend::transfer(lower);
 
         }
         /**
          * Hold the latch low and shift out two bytes of data!
          */
         void shiftOut(int16_t value) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 8) & 0x00FF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, value);
+            Transaction transaction;
+            Backend::transfer((value >> 8) & 0x00FF);
+            Backend::transfer(value);
         }
         /**
          * Hold the latch low and shift 4 bytes of data!
          */
         void shiftOut(uint32_t value) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 24) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 16) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 8) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, value & 0xFF);
+            Transaction transaction;
+            Backend::transfer((value >> 24) & 0xFF);
+            Backend::transfer((value >> 16) & 0xFF);
+            Backend::transfer((value >> 8) & 0xFF);
+            Backend::transfer(value & 0xFF);
         }
         /**
          * Hold the latch low and shift 4 bytes of data!
          */
         void shiftOut(int32_t value) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 24) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 16) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 8) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, value & 0xFF);
+            Transaction transaction;
+            Backend::transfer((value >> 24) & 0xFF);
+            Backend::transfer((value >> 16) & 0xFF);
+            Backend::transfer((value >> 8) & 0xFF);
+            Backend::transfer(value & 0xFF);
         }
         /**
          * Hold the latch low and shift 8 bytes of data!
          */
         void shiftOut(uint64_t value) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 56) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 48) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 40) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 32) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 24) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 16) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 8) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, value);
+            Transaction transaction;
+            Backend::transfer((value >> 56) & 0xFF);
+            Backend::transfer((value >> 48) & 0xFF);
+            Backend::transfer((value >> 40) & 0xFF);
+            Backend::transfer((value >> 32) & 0xFF);
+            Backend::transfer((value >> 24) & 0xFF);
+            Backend::transfer((value >> 16) & 0xFF);
+            Backend::transfer((value >> 8) & 0xFF);
+            Backend::transfer(value);
         }
         /**
          * Hold the latch low and shift 8 bytes of data!
          */
         void shiftOut(int64_t value) noexcept {
-            LatchHolder latch;
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 56) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 48) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 40) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 32) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 24) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 16) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, (value >> 8) & 0xFF);
-            ::shiftOut(DS, SH_CP, MSBFIRST, value);
-        }
-        template<typename T, typename ... Args>
-        void shiftOutMultiple(T current, Args&& ... rest) noexcept {
-            shiftOut(current);
-            if (sizeof...(rest) > 0) {
-                shiftOutMultiple(rest...);
+            Transaction transaction;
+            Backend::transfer((value >> 56) & 0xFF);
+            Backend::transfer((value >> 48) & 0xFF);
+            Backend::transfer((value >> 40) & 0xFF);
+            Backend::transfer((value >> 32) & 0xFF);
+            Backend::transfer((value >> 24) & 0xFF);
+            Backend::transfer((value >> 16) & 0xFF);
+            Backend::transfer((value >> 8) & 0xFF);
+            Backend::transfer(value);
+        }
+        /**
+         * Hold the latch low once and shift out every value exactly as
+         * shiftOut would (most significant byte first, arrays in element
+         * order) so the outputs only change when the last byte is in place.
+         */
+        template<typename ... Args>
+        void shiftOutMultiple(const Args& ... values) noexcept {
+            static_assert(sizeof...(values) > 0, "Nothing to shift out!");
+            Transaction transaction;
+            (transferItem<MSBFIRST, MostSignificantFirst>(values), ...);
+        }
+        /**
+         * Hold the latch low and shift out the bytes of any trivially
+         * copyable value. Arrays go out element by element starting with
+         * element 0, like the span version; a string literal includes its
+         * terminating NUL.
+         * @tparam bitOrder MSBFIRST or LSBFIRST, applied to every byte
+         * @tparam ByteOrder MostSignificantFirst or LeastSignificantFirst,
+         * applied to every element
+         */
+        template<decltype(MSBFIRST) bitOrder = MSBFIRST, typename ByteOrder = MostSignificantFirst, typename T>
+        void shiftOut(const T& value) noexcept {
+            Transaction transaction;
+            transferItem<bitOrder, ByteOrder>(value);
+        }
+        /**
+         * Hold the latch low once and shift out length bytes starting with
+         * data[0], however long the chain is.
+         * @tparam bitOrder MSBFIRST or LSBFIRST, applied to every byte
+         */
+        template<decltype(MSBFIRST) bitOrder = MSBFIRST>
+        void shiftOut(const uint8_t* data, size_t length) noexcept {
+            Transaction transaction;
+            for (size_t i = 0; i < length; ++i) {
+                transferByte<bitOrder>(data[i]);
             }
         }
         template<typename T>
-        Self& operator<<(T value) noexcept {
+        Self& operator<<(const T& value) noexcept {
             shiftOut(value);
             return *this;
         }
+    private:
+        template<decltype(MSBFIRST) bitOrder, typename ByteOrder, typename T>
+        static void transferItem(const T& value) noexcept {
+            transferValue<bitOrder, ByteOrder>(value);
+        }
+        template<decltype(MSBFIRST) bitOrder, typename ByteOrder, typename E, size_t N>
+        static void transferItem(const E (&values)[N]) noexcept {
+            for (size_t i = 0; i < N; ++i) {
+                transferItem<bitOrder, ByteOrder>(values[i]);
+            }
+        }
+        template<decltype(MSBFIRST) bitOrder>
+        static void transferByte(byte value) noexcept {
+            if constexpr (bitOrder == LSBFIRST) {
+                value = static_cast<byte>((value >> 4) | (value << 4));
+                value = static_cast<byte>(((value & 0xCC) >> 2) | ((value & 0x33) << 2));
+                value = static_cast<byte>(((value & 0xAA) >> 1) | ((value & 0x55) << 1));
+            }
+            Backend::transfer(value);
+        }
+        template<decltype(MSBFIRST) bitOrder, typename ByteOrder, typename T>
+        static void transferValue(const T& value) noexcept {
+            static_assert(__is_trivially_copyable(T), "Only trivially copyable values can be shifted out!");
+            static_assert(!IsPointer<T>::Value, "Shifting out a pointer sends its address, pass a length to shift out what it points to!");
+            auto bytes = reinterpret_cast<const byte*>(&value);
+            // sizeof is a constant so this unrolls into one transfer per byte
+            for (size_t i = 0; i < sizeof(T); ++i) {
+                transferByte<bitOrder>(bytes[ByteOrder::StartsAtHighAddress ? (sizeof(T) - 1 - i) : i]);
+            }
+        }
+};
+
+/**
+ * A chain of N daisy chained HC595s driven from an in-memory copy of their
+ * outputs. Bits are changed in RAM and flush() pushes the whole chain out
+ * under a single latch pulse, so all of the outputs change together; a frame
+ * which has not changed since the last flush is not sent at all.
+ *
+ * Output bit n is pin Qn%8 of chip n/8, chip 0 being the one wired to the
+ * microcontroller.
+ * @tparam N the number of chips in the chain
+ * @tparam ST_CP the pin connected to ST_CP of every 74HC595
+ * @tparam SH_CP the pin connected to SH_CP of the first 74HC595
+ * @tparam DS the pin connected to DS of the first 74HC595
+ * @tparam Backend how bytes are clocked into the chain
+ */
+template<size_t N, int ST_CP, int SH_CP, int DS, typename Backend = ArduinoShiftOutBackend<SH_CP, DS>>
+class HC595Chain {
+    public:
+        static_assert(N > 0, "A chain needs at least one chip!");
+        using Self = HC595Chain<N, ST_CP, SH_CP, DS, Backend>;
+        using Register = HC595<ST_CP, SH_CP, DS, Backend>;
+        static constexpr size_t Length = N;
+        static constexpr size_t Width = N * 8;
+    public:
+        HC595Chain() = default;
+        ~HC595Chain() = default;
+        HC595Chain(const Self&) = delete;
+        HC595Chain(Self&&) = delete;
+        Self& operator=(const Self&) = delete;
+        Self& operator=(Self&&) = delete;
+        void setupPins() { _register.setupPins(); }
+        void begin() { _register.begin(); }
+        void set(size_t bit) noexcept { write(bit, true); }
+        void clear(size_t bit) noexcept { write(bit, false); }
+        void toggle(size_t bit) noexcept {
+            if (bit < Width) {
+                _frame[bit / 8] ^= mask(bit);
+                _dirty = true;
+            }
+        }
+        void write(size_t bit, bool value) noexcept {
+            if (bit < Width) {
+                auto old = _frame[bit / 8];
+                auto updated = value ? (old | mask(bit)) : (old & static_cast<byte>(~mask(bit)));
+                if (updated != old) {
+                    _frame[bit / 8] = updated;
+                    _dirty = true;
+                }
+            }
+        }
+        bool get(size_t bit) const noexcept {
+            return (bit < Width) && (_frame[bit / 8] & mask(bit));
+        }
+        /**
+         * Replace the outputs of a single chip
+         */
+        void setByte(size_t chip, byte value) noexcept {
+            if (chip < Length && _frame[chip] != value) {
+                _frame[chip] = value;
+                _dirty = true;
+            }
+        }
+        byte getByte(size_t chip) const noexcept { return chip < Length ? _frame[chip] : 0; }
+        /**
+         * Set every output of the chain to the given level
+         */
+        void fill(bool value) noexcept {
+            for (size_t i = 0; i < Length; ++i) {
+                setByte(i, value ? 0xFF : 0x00);
+            }
+        }
+        bool isDirty() const noexcept { return _dirty; }
+        /**
+         * Force the next flush to send the frame, for when the chips may
+         * have lost their state
+         */
+        void markDirty() noexcept { _dirty = true; }
+        /**
+         * Shift the frame out if it changed since the last flush, the chip
+         * furthest down the chain goes first.
+         * @return true if the chain was updated
+         */
+        bool flush() noexcept {
+            if (!_dirty) {
+                return false;
+            }
+            {
+                typename Register::Transaction transaction;
+                for (size_t i = Length; i > 0; --i) {
+                    _register.shiftOutUnlatched(_frame[i - 1]);
+                }
+            }
+            _dirty = false;
+            return true;
+        }
+    private:
+        static constexpr byte mask(size_t bit) noexcept { return static_cast<byte>(1 << (bit % 8)); }
+    private:
+        Register _register;
+        byte _frame[N] = { 0 };
+        // the chips start out in an unknown state
+        bool _dirty = true;
 };
 
 template<int selA, int selB, int selC, int enablePin = -1>
@@ -328,7 +676,7 @@ class HC165 {
         }
 
 };
-template<int ST_CP, int SH_CP, int DS>
-using SN74HC595 = HC595<ST_CP, SH_CP, DS>;
+template<int ST_CP, int SH_CP, int DS, typename Backend = ArduinoShiftOutBackend<SH_CP, DS>>
+using SN74HC595 = HC595<ST_CP, SH_CP, DS, Backend>;
 } // end namespace bonuspin
 #endif // end LIB_ICS_X74SERIES_H__
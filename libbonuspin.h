@@ -26,8 +26,19 @@
 #error "C++17 required!"
 #endif
 #include "core/concepts.h"
+#include "core/fastpin.h"
+#include "core/spitransport.h"
+#include "core/ringbuffer.h"
+#include "core/debounce.h"
 #include "core/leds.h"
 #include "ics/x74Series.h"
+#include "ics/MCP23x17.h"
 #include "ics/MCP23S17.h"
+#include "ics/mcp23x17/InterruptCapture.h"
+#include "ics/mcp23x17/BusManager.h"
+#include "ics/mcp23x17/Keypad.h"
+#include "ics/mcp23x17/ChangePoller.h"
+#include "ics/mcp23x17/ParallelBus.h"
+#include "ics/mcp23x17/VirtualPort.h"
 #include "ics/memory/Series_23LCxx.h"
 #endif // end LIB_BONUSPIN_H__